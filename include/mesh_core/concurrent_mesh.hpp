@@ -0,0 +1,199 @@
+#pragma once
+
+// first include
+#include "mesh_core/config.hpp"
+
+// other include
+#include "mesh_core/data_view.hpp"
+#include "mesh_core/detail/mpsc_ring.hpp"
+#include "mesh_core/detail/noncopyable.hpp"
+#include "mesh_core/route_table.hpp"
+#include "mesh_core/type.hpp"
+
+// std
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace mesh_core {
+
+/**
+ * read-only copy of the route table, shared by reader threads
+ */
+struct route_snapshot {
+  std::vector<route_info> routes;  // in slot order
+  uint32_t version{};              // increased by each publish
+
+  /**
+   * @return nullptr if no route
+   */
+  const route_info* find(addr_t dst) const {
+    for (const auto& r : routes) {
+      if (r.dst == dst) return &r;
+    }
+    return nullptr;
+  }
+};
+
+/**
+ * thread-safe front-end of a mesh, for hosts where many threads produce data, e.g. a Linux gateway.
+ *
+ * 1. `send()`/`broadcast()` from any thread copy the data into a bounded lock-free ring, no lock and no heap allocation
+ * 2. the owner thread of the mesh runs them in batches by `drain()`, scheduled by `notify` once per batch, not per command
+ * 3. `routes()` from any thread returns the last published route table, published by `drain()` if changed
+ *
+ * the mesh itself is still single-threaded, call anything else of it(and its handles are called) on the owner thread.
+ * not included by mesh_core.hpp, need <atomic> and heap for route snapshots.
+ *
+ * @tparam Mesh mesh<Impl, Config>
+ */
+template <typename Mesh, size_t QueueNum = MESH_CORE_CONCURRENT_QUEUE_NUM>
+class concurrent_mesh : detail::noncopyable {
+ public:
+  // schedule `drain()` on the owner thread, called from producer threads, e.g. asio::post
+  using notify_t = std::function<void()>;
+  static const uint8_t DataSizeMax = Mesh::DataSizeMax;
+  static const size_t Batch = MESH_CORE_CONCURRENT_BATCH;
+  static_assert(Batch > 0, "batch error");
+
+ public:
+  concurrent_mesh(Mesh& mesh, notify_t notify) : mesh_(mesh), notify_(std::move(notify)) {
+    std::atomic_store(&routes_, std::make_shared<const route_snapshot>());
+  }
+
+  /**
+   * any thread
+   * @return false if data too large or the queue is full(backpressure)
+   */
+  bool send(addr_t dst, data_view data) {
+    return push(op::send, dst, data);
+  }
+
+  /**
+   * any thread
+   */
+  bool broadcast(data_view data) {
+    return push(op::broadcast, {}, data);
+  }
+
+  /**
+   * owner thread, run at most `Batch` queued commands, then publish routes
+   * @return commands run
+   */
+  size_t drain() {
+    // acquire: commands pushed before the last notify are visible
+    notified_.exchange(false, std::memory_order_acq_rel);
+    size_t n = 0;
+    while (n < Batch && ring_.pop([this](command& c) {
+      run(c);
+    })) {
+      ++n;
+    }
+    ring_.sync_tail();
+    if (n == Batch) notify();
+    publish_routes();
+    return n;
+  }
+
+  /**
+   * owner thread, publish routes if changed, `drain()` does it, call it from a timer if nothing is sent
+   */
+  void publish_routes() {
+    scratch_.clear();
+    mesh_.for_each_route([this](const route_info& info) {
+      scratch_.push_back(info);
+    });
+    auto current = std::atomic_load(&routes_);
+    if (same_routes(current->routes, scratch_)) return;
+    auto snapshot = std::make_shared<route_snapshot>();
+    snapshot->routes = scratch_;
+    snapshot->version = current->version + 1;
+    std::atomic_store(&routes_, std::shared_ptr<const route_snapshot>(std::move(snapshot)));
+  }
+
+  /**
+   * any thread, the snapshot never changes, get a new one for updates
+   */
+  std::shared_ptr<const route_snapshot> routes() const {
+    return std::atomic_load(&routes_);
+  }
+
+  /**
+   * any thread, queued commands, may be stale
+   */
+  size_t pending() const {
+    return ring_.size_approx();
+  }
+
+  /**
+   * any thread, commands run but failed in mesh, e.g. tx queue full
+   */
+  uint32_t failed() const {
+    return failed_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  enum class op : uint8_t {
+    send,
+    broadcast,
+  };
+
+  struct command {
+    op type;
+    addr_t dst;
+    uint8_t size;
+    uint8_t data[DataSizeMax];
+  };
+
+  bool push(op type, addr_t dst, data_view data) {
+    if (data.size() > DataSizeMax) return false;
+    bool ok = ring_.push([&](command& c) {
+      c.type = type;
+      c.dst = dst;
+      c.size = (uint8_t)data.size();
+      if (c.size) memcpy(c.data, data.data(), c.size);
+    });
+    if (!ok) return false;
+    notify();
+    return true;
+  }
+
+  /**
+   * only the first one after `drain()` schedules it
+   */
+  void notify() {
+    if (!notified_.exchange(true, std::memory_order_acq_rel)) notify_();
+  }
+
+  void run(const command& c) {
+    data_view data(c.data, c.size);
+    bool ok = c.type == op::send ? mesh_.send(c.dst, data) : mesh_.broadcast(data);
+    if (!ok) failed_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  static bool same_routes(const std::vector<route_info>& a, const std::vector<route_info>& b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+      const auto& x = a[i];
+      const auto& y = b[i];
+      if (x.dst != y.dst || x.next_hop != y.next_hop || x.metric != y.metric || x.lqs != y.lqs || x.iface != y.iface) return false;
+    }
+    return true;
+  }
+
+ private:
+  Mesh& mesh_;
+  notify_t notify_;
+  detail::mpsc_ring<command, QueueNum> ring_;
+  std::atomic<bool> notified_{false};
+  std::atomic<uint32_t> failed_{0};
+  std::shared_ptr<const route_snapshot> routes_;
+  std::vector<route_info> scratch_;
+};
+
+}  // namespace mesh_core
@@ -2,6 +2,32 @@
 
 #include "version.hpp"
 
+/// address width in bits, 8 or 16, 16 for more than 255 nodes, changes the wire format
+#ifndef MESH_CORE_ADDR_BITS
+#define MESH_CORE_ADDR_BITS 8
+#endif
+
+/// sequence width in bits, 8 or 16, 16 for high message rate per source, changes the wire format
+#ifndef MESH_CORE_SEQ_BITS
+#define MESH_CORE_SEQ_BITS 8
+#endif
+
+/// route table slots for 16bit address(hashed), power of 2, 8bit address is direct indexed
+#ifndef MESH_CORE_ROUTE_TABLE_SIZE
+#define MESH_CORE_ROUTE_TABLE_SIZE 512
+#endif
+
+/// route table slots of an instance without routing(Config::Route = false), power of 2, hashed.
+/// it only learns next hops for its own messages, routes are dropped when full
+#ifndef MESH_CORE_LEAF_ROUTE_TABLE_SIZE
+#define MESH_CORE_LEAF_ROUTE_TABLE_SIZE 32
+#endif
+
+/// duplicate filter sources for 16bit address, least recently heard one is replaced, 8bit address keeps all
+#ifndef MESH_CORE_DUP_SOURCE_NUM
+#define MESH_CORE_DUP_SOURCE_NUM 64
+#endif
+
 #ifndef MESH_CORE_DELAY_MS_MIN
 #define MESH_CORE_DELAY_MS_MIN 100
 #endif
@@ -14,18 +40,221 @@
 #define MESH_CORE_TTL_DEFAULT 10
 #endif
 
-#ifndef MESH_CORE_LRU_RECORD_SIZE
-#define MESH_CORE_LRU_RECORD_SIZE 32
+#ifndef MESH_CORE_DUP_WINDOW_SIZE
+#define MESH_CORE_DUP_WINDOW_SIZE 64
+#endif
+
+#ifndef MESH_CORE_DUP_EXPIRED_MS
+#define MESH_CORE_DUP_EXPIRED_MS (10 * 1000)
 #endif
 
 #ifndef MESH_CORE_ROUTE_EXPIRED_MS
 #define MESH_CORE_ROUTE_EXPIRED_MS (60 * 1000)
 #endif
 
+/// full route sync, route changes are advertised by triggered update, so this is only a refresh
 #ifndef MESH_CORE_ROUTE_SYNC_INTERVAL_MS
-#define MESH_CORE_ROUTE_SYNC_INTERVAL_MS (10 * 1000)
+#define MESH_CORE_ROUTE_SYNC_INTERVAL_MS (20 * 1000)
+#endif
+
+/// withdrawn route ignore other next hops during this time, avoid routing loop
+#ifndef MESH_CORE_ROUTE_HOLD_DOWN_MS
+#define MESH_CORE_ROUTE_HOLD_DOWN_MS (5 * 1000)
+#endif
+
+/// routes learned from a degraded next hop keep the lowest lqs during this time, unless it is heard forwarding again
+#ifndef MESH_CORE_ROUTE_DEGRADE_MS
+#define MESH_CORE_ROUTE_DEGRADE_MS MESH_CORE_ROUTE_EXPIRED_MS
+#endif
+
+/// degraded next hops remembered at the same time, the oldest one is replaced
+#ifndef MESH_CORE_ROUTE_DEGRADE_NUM
+#define MESH_CORE_ROUTE_DEGRADE_NUM 4
+#endif
+
+/// min interval of triggered route update
+#ifndef MESH_CORE_ROUTE_TRIGGER_INTERVAL_MS
+#define MESH_CORE_ROUTE_TRIGGER_INTERVAL_MS (1 * 1000)
 #endif
 
 #ifndef MESH_CORE_ROUTE_CHECK_EXPIRED_INTERVAL_MS
 #define MESH_CORE_ROUTE_CHECK_EXPIRED_INTERVAL_MS (5 * 1000)
 #endif
+
+/// broadcast storm suppression, cancel pending rebroadcast after heard the same message this many times(include the first one)
+/// 0 for disable
+#ifndef MESH_CORE_REBROADCAST_COUNTER_THRESHOLD
+#define MESH_CORE_REBROADCAST_COUNTER_THRESHOLD 3
+#endif
+
+/// cancel pending rebroadcast if heard a copy with lqs higher than the first one by this margin
+#ifndef MESH_CORE_REBROADCAST_LQS_MARGIN
+#define MESH_CORE_REBROADCAST_LQS_MARGIN 20
+#endif
+
+/// max rebroadcasts can be cancelled at the same time
+#ifndef MESH_CORE_REBROADCAST_PENDING_NUM
+#define MESH_CORE_REBROADCAST_PENDING_NUM 8
+#endif
+
+/// internal timer num, for route sync and pending rebroadcasts
+#ifndef MESH_CORE_TIMER_NUM
+#define MESH_CORE_TIMER_NUM 32
+#endif
+
+/// timer resolution, bigger value for less wakeup on mcu
+#ifndef MESH_CORE_TIMER_TICK_MS
+#define MESH_CORE_TIMER_TICK_MS 1
+#endif
+
+/// inline storage of callbacks(handles, interceptors, timers) in bytes, no heap allocation
+#ifndef MESH_CORE_FUNCTION_CAPACITY
+#define MESH_CORE_FUNCTION_CAPACITY 48
+#endif
+
+/// frames can be pending for rebroadcast, each one takes a max size frame
+#ifndef MESH_CORE_FRAME_POOL_NUM
+#define MESH_CORE_FRAME_POOL_NUM 8
+#endif
+
+/// when frame pool is full:
+/// 0: drop the new frame, counted as drop_reason::pool_full
+/// 1: drop the oldest pending frame, counted as mesh_stats::pool_evictions
+#ifndef MESH_CORE_FRAME_POOL_POLICY
+#define MESH_CORE_FRAME_POOL_POLICY 0
+#endif
+
+/// frames can wait for tx done of Impl, see Impl::set_tx_done_handle
+#ifndef MESH_CORE_TX_QUEUE_NUM
+#define MESH_CORE_TX_QUEUE_NUM 8
+#endif
+
+/// queued frames older than this are dropped instead of sent
+#ifndef MESH_CORE_TX_DEADLINE_MS
+#define MESH_CORE_TX_DEADLINE_MS (2 * 1000)
+#endif
+
+/// transmit duty cycle limit in permille, 0 for unlimited, e.g. 10 for EU868 1%, see mesh::set_duty_cycle
+#ifndef MESH_CORE_DUTY_CYCLE_PERMILLE
+#define MESH_CORE_DUTY_CYCLE_PERMILLE 0
+#endif
+
+#ifndef MESH_CORE_DUTY_CYCLE_WINDOW_MS
+#define MESH_CORE_DUTY_CYCLE_WINDOW_MS (3600 * 1000)
+#endif
+
+/// airtime accounting granularity, more slots for more accurate sliding window
+#ifndef MESH_CORE_AIRTIME_SLOTS
+#define MESH_CORE_AIRTIME_SLOTS 16
+#endif
+
+/// percent of the budget only routing and time sync can use
+#ifndef MESH_CORE_AIRTIME_RESERVE_PERCENT
+#define MESH_CORE_AIRTIME_RESERVE_PERCENT 20
+#endif
+
+/// bits per second for airtime if Impl has no `airtime_us`, 0 for no airtime accounting
+#ifndef MESH_CORE_AIRTIME_BITRATE
+#define MESH_CORE_AIRTIME_BITRATE 0
+#endif
+
+/// fragments of one large payload at most, limit the size of `mesh::send_large`, need Fragment of Config
+#ifndef MESH_CORE_FRAGMENT_NUM_MAX
+#define MESH_CORE_FRAGMENT_NUM_MAX 512
+#endif
+
+/// interval between fragments of `mesh::send_large`
+#ifndef MESH_CORE_FRAGMENT_INTERVAL_MS
+#define MESH_CORE_FRAGMENT_INTERVAL_MS 100
+#endif
+
+/// large payloads can be reassembled at the same time
+#ifndef MESH_CORE_REASSEMBLY_NUM
+#define MESH_CORE_REASSEMBLY_NUM 2
+#endif
+
+/// reassembly buffer of each payload in bytes, larger payloads need `mesh::on_recv_fragment`
+#ifndef MESH_CORE_REASSEMBLY_SIZE
+#define MESH_CORE_REASSEMBLY_SIZE 1024
+#endif
+
+/// incomplete payload is dropped after no fragment received for this time
+#ifndef MESH_CORE_REASSEMBLY_TIMEOUT_MS
+#define MESH_CORE_REASSEMBLY_TIMEOUT_MS (10 * 1000)
+#endif
+
+/// reliable messages pending for ack in total, each one takes a max size frame, need Reliable of Config
+#ifndef MESH_CORE_RELIABLE_TX_NUM
+#define MESH_CORE_RELIABLE_TX_NUM 8
+#endif
+
+/// reliable messages can be in flight to one destination, <= 32
+#ifndef MESH_CORE_RELIABLE_WINDOW
+#define MESH_CORE_RELIABLE_WINDOW 4
+#endif
+
+/// peers with reliable state, for both sending and receiving
+#ifndef MESH_CORE_RELIABLE_PEER_NUM
+#define MESH_CORE_RELIABLE_PEER_NUM 4
+#endif
+
+/// retransmissions before a reliable message fails
+#ifndef MESH_CORE_RELIABLE_RETRY
+#define MESH_CORE_RELIABLE_RETRY 5
+#endif
+
+/// retransmission timeout before the first rtt sample, then estimated from rtt
+#ifndef MESH_CORE_RELIABLE_RTO_INIT_MS
+#define MESH_CORE_RELIABLE_RTO_INIT_MS (3 * 1000)
+#endif
+
+#ifndef MESH_CORE_RELIABLE_RTO_MIN_MS
+#define MESH_CORE_RELIABLE_RTO_MIN_MS 200
+#endif
+
+#ifndef MESH_CORE_RELIABLE_RTO_MAX_MS
+#define MESH_CORE_RELIABLE_RTO_MAX_MS (60 * 1000)
+#endif
+
+/// frames can wait for the next hop forwarding them(implicit ack), each one takes a max size frame, need HopAck of Config
+#ifndef MESH_CORE_HOP_ACK_NUM
+#define MESH_CORE_HOP_ACK_NUM 8
+#endif
+
+/// retransmit if the next hop is not heard forwarding in this time
+#ifndef MESH_CORE_HOP_ACK_TIMEOUT_MS
+#define MESH_CORE_HOP_ACK_TIMEOUT_MS (1 * 1000)
+#endif
+
+/// retransmissions before routes via the next hop are degraded
+#ifndef MESH_CORE_HOP_ACK_RETRY
+#define MESH_CORE_HOP_ACK_RETRY 2
+#endif
+
+/// commands can be queued by other threads for `concurrent_mesh`, power of 2, each one takes a max size frame
+#ifndef MESH_CORE_CONCURRENT_QUEUE_NUM
+#define MESH_CORE_CONCURRENT_QUEUE_NUM 64
+#endif
+
+/// commands run by one `concurrent_mesh::drain()`, the rest are left for the next one so the owner thread is not blocked
+#ifndef MESH_CORE_CONCURRENT_BATCH
+#define MESH_CORE_CONCURRENT_BATCH 16
+#endif
+
+/// nodes of one `mesh_host` shard(worker thread), each one takes a timer of the shard
+#ifndef MESH_CORE_HOST_SHARD_NODE_NUM
+#define MESH_CORE_HOST_SHARD_NODE_NUM 256
+#endif
+
+/// frames and tasks can be queued to one `mesh_host` shard, power of 2, each one takes a max size frame, more are dropped
+#ifndef MESH_CORE_HOST_INBOX_NUM
+#define MESH_CORE_HOST_INBOX_NUM 256
+#endif
+
+/// crc16 implementation:
+/// 0: 4bit table, 32 bytes rom
+/// 1: 8bit table, 512 bytes rom
+/// 2: slice-by-8, 4K bytes rom
+#ifndef MESH_CORE_CRC16_IMPL
+#define MESH_CORE_CRC16_IMPL 1
+#endif
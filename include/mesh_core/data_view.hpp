@@ -0,0 +1,68 @@
+#pragma once
+
+// std
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+namespace mesh_core {
+
+/**
+ * non-owning view of binary data, like std::string_view(C++17)
+ *
+ * NOTE:
+ * 1. only valid during the callback, copy it if you want to keep
+ * 2. can convert to std::string implicitly, for compatible with handles use `data_t`, but this will copy
+ */
+class data_view {
+ public:
+  data_view() = default;
+
+  data_view(const void* data, size_t size) : data_(static_cast<const char*>(data)), size_(size) {}
+
+  data_view(const std::string& str) : data_(str.data()), size_(str.size()) {}  // NOLINT
+
+  data_view(const char* str) : data_(str), size_(strlen(str)) {}  // NOLINT
+
+  const char* data() const {
+    return data_;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  const char* begin() const {
+    return data_;
+  }
+
+  const char* end() const {
+    return data_ + size_;
+  }
+
+  std::string to_string() const {
+    return {data_, size_};
+  }
+
+  operator std::string() const {  // NOLINT
+    return to_string();
+  }
+
+  bool operator==(data_view other) const {
+    return size_ == other.size_ && (size_ == 0 || memcmp(data_, other.data_, size_) == 0);
+  }
+
+  bool operator!=(data_view other) const {
+    return !(*this == other);
+  }
+
+ private:
+  const char* data_{};
+  size_t size_{};
+};
+
+}  // namespace mesh_core
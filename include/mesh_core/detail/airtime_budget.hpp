@@ -0,0 +1,127 @@
+#pragma once
+
+// config
+#include "../config.hpp"
+#include "../type.hpp"
+#include "noncopyable.hpp"
+
+// std
+#include <cstddef>
+#include <cstdint>
+
+namespace mesh_core {
+namespace detail {
+
+/**
+ * transmit airtime limit over a sliding window, for duty cycle regulated bands(e.g. EU868 1%).
+ *
+ * 1. the window is split into `SlotNum` slots, airtime is counted into the current slot
+ * 2. a slot leaves the window only after its end is older than the window, so it never allows more than the limit
+ * 3. `reserve_us` lets low priority traffic stop early and leave the rest for routing
+ */
+class airtime_budget : noncopyable {
+ public:
+  static const uint32_t SlotNum = MESH_CORE_AIRTIME_SLOTS;
+  static_assert(SlotNum > 0, "airtime slots error");
+
+ public:
+  /**
+   * @param permille 0 for unlimited
+   */
+  void set_limit(timestamp_t now, uint16_t permille, uint32_t window_ms) {
+    slot_ms_ = window_ms / SlotNum;
+    if (slot_ms_ == 0) slot_ms_ = 1;
+    limit_us_ = (uint32_t)((uint64_t)slot_ms_ * SlotNum * permille);
+    enabled_ = permille != 0;
+    reset(now);
+  }
+
+  bool enabled() const {
+    return enabled_;
+  }
+
+  uint32_t limit_us() const {
+    return limit_us_;
+  }
+
+  /**
+   * @return remaining airtime in the window, UINT32_MAX if unlimited
+   */
+  uint32_t remaining(timestamp_t now) {
+    if (!enabled_) return UINT32_MAX;
+    advance(now);
+    return used_us_ >= limit_us_ ? 0 : limit_us_ - used_us_;
+  }
+
+  /**
+   * @return true if `cost_us` can be sent and still leave `reserve_us`
+   */
+  bool allow(timestamp_t now, uint32_t cost_us, uint32_t reserve_us = 0) {
+    if (!enabled_) return true;
+    uint32_t left = remaining(now);
+    return left >= reserve_us && left - reserve_us >= cost_us;
+  }
+
+  void consume(timestamp_t now, uint32_t cost_us) {
+    if (!enabled_) return;
+    advance(now);
+    slots_[cur_] += cost_us;
+    used_us_ += cost_us;
+  }
+
+  /**
+   * @return ms to wait for `allow()` become true, UINT32_MAX if never
+   */
+  uint32_t wait_ms(timestamp_t now, uint32_t cost_us, uint32_t reserve_us = 0) {
+    if (allow(now, cost_us, reserve_us)) return 0;
+    uint64_t need = (uint64_t)cost_us + reserve_us;
+    if (need > limit_us_) return UINT32_MAX;
+    uint64_t left = limit_us_ - used_us_;
+    // oldest slots leave the window first, the current slot is the last
+    for (uint32_t n = 1; n <= SlotNum + 1; ++n) {
+      left += slots_[(cur_ + n) % (SlotNum + 1)];
+      if (left >= need) {
+        return (cur_start_ + n * slot_ms_) - now;
+      }
+    }
+    return UINT32_MAX;
+  }
+
+ private:
+  void reset(timestamp_t now) {
+    for (auto& s : slots_) {
+      s = 0;
+    }
+    used_us_ = 0;
+    cur_ = 0;
+    cur_start_ = now;
+  }
+
+  void advance(timestamp_t now) {
+    uint32_t elapsed = now - cur_start_;
+    if (elapsed < slot_ms_) return;
+    if (elapsed / slot_ms_ > SlotNum) {
+      reset(now);
+      return;
+    }
+    while (now - cur_start_ >= slot_ms_) {
+      cur_ = (cur_ + 1) % (SlotNum + 1);
+      cur_start_ += slot_ms_;
+      used_us_ -= slots_[cur_];
+      slots_[cur_] = 0;
+    }
+  }
+
+ private:
+  // current slot and SlotNum full slots before it cover the whole window
+  uint32_t slots_[SlotNum + 1]{};
+  uint32_t used_us_{};
+  uint32_t limit_us_{};
+  uint32_t slot_ms_{1};
+  uint32_t cur_{};
+  timestamp_t cur_start_{};
+  bool enabled_{};
+};
+
+}  // namespace detail
+}  // namespace mesh_core
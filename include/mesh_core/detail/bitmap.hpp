@@ -0,0 +1,159 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+namespace mesh_core {
+namespace detail {
+
+inline int ctz32(uint32_t v) {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_ctz(v);
+#elif defined(_MSC_VER)
+  unsigned long i;
+  _BitScanForward(&i, v);
+  return (int)i;
+#else
+  int n = 0;
+  while (!(v & 1)) {
+    v >>= 1;
+    ++n;
+  }
+  return n;
+#endif
+}
+
+/**
+ * v should not be 0
+ */
+inline int ctz64(uint64_t v) {
+  uint32_t lo = (uint32_t)v;
+  return lo ? ctz32(lo) : 32 + ctz32((uint32_t)(v >> 32));
+}
+
+inline int popcount32(uint32_t v) {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_popcount(v);
+#else
+  v = v - ((v >> 1) & 0x55555555u);
+  v = (v & 0x33333333u) + ((v >> 2) & 0x33333333u);
+  return (int)((((v + (v >> 4)) & 0x0F0F0F0Fu) * 0x01010101u) >> 24);
+#endif
+}
+
+/**
+ * fixed size bitmap, use 32bit words for mcu friendly
+ */
+template <size_t N>
+class bitmap {
+ public:
+  static const size_t Size = N;
+
+  bool test(size_t i) const {
+    return (words_[i / WordBits] >> (i % WordBits)) & 1u;
+  }
+
+  void set(size_t i) {
+    words_[i / WordBits] |= (1u << (i % WordBits));
+  }
+
+  void reset(size_t i) {
+    words_[i / WordBits] &= ~(1u << (i % WordBits));
+  }
+
+  void clear() {
+    for (auto& w : words_) {
+      w = 0;
+    }
+  }
+
+  bool any() const {
+    for (auto w : words_) {
+      if (w) return true;
+    }
+    return false;
+  }
+
+  size_t count() const {
+    size_t n = 0;
+    for (auto w : words_) {
+      n += popcount32(w);
+    }
+    return n;
+  }
+
+  /**
+   * @return count of bits set in both
+   */
+  size_t count_common(const bitmap& other) const {
+    size_t n = 0;
+    for (size_t i = 0; i < WordNum; ++i) {
+      n += popcount32(words_[i] & other.words_[i]);
+    }
+    return n;
+  }
+
+  bool operator==(const bitmap& other) const {
+    for (size_t i = 0; i < WordNum; ++i) {
+      if (words_[i] != other.words_[i]) return false;
+    }
+    return true;
+  }
+
+  bool operator!=(const bitmap& other) const {
+    return !(*this == other);
+  }
+
+  bitmap& operator|=(const bitmap& other) {
+    for (size_t i = 0; i < WordNum; ++i) {
+      words_[i] |= other.words_[i];
+    }
+    return *this;
+  }
+
+  bitmap& operator^=(const bitmap& other) {
+    for (size_t i = 0; i < WordNum; ++i) {
+      words_[i] ^= other.words_[i];
+    }
+    return *this;
+  }
+
+  /**
+   * clear bits set in other
+   */
+  bitmap& remove(const bitmap& other) {
+    for (size_t i = 0; i < WordNum; ++i) {
+      words_[i] &= ~other.words_[i];
+    }
+    return *this;
+  }
+
+  /**
+   * @return index of first set bit >= from, or N if none
+   */
+  size_t find_next(size_t from) const {
+    if (from >= N) return N;
+    size_t word = from / WordBits;
+    uint32_t bits = words_[word] & (~0u << (from % WordBits));
+    for (;;) {
+      if (bits) {
+        size_t i = word * WordBits + ctz32(bits);
+        return i < N ? i : N;
+      }
+      if (++word >= WordNum) return N;
+      bits = words_[word];
+    }
+  }
+
+ private:
+  static const size_t WordBits = 32;
+  static const size_t WordNum = (N + WordBits - 1) / WordBits;
+  uint32_t words_[WordNum]{};
+};
+
+}  // namespace detail
+}  // namespace mesh_core
@@ -0,0 +1,178 @@
+#pragma once
+
+// config
+#include "../config.hpp"
+#include "../type.hpp"
+#include "noncopyable.hpp"
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace mesh_core {
+namespace detail {
+
+/**
+ * duplicate filter, a sliding sequence window for each source address, like IPsec anti-replay.
+ * O(1) check and no heap allocation.
+ *
+ * bit k of the window means `seq - k` has been seen, seq is the newest one from the source.
+ * the message ts is used to detect source reboot(seq restart).
+ *
+ * 8bit address keeps all sources. 16bit address keeps MESH_CORE_DUP_SOURCE_NUM sources in `Ways` way sets,
+ * the least recently heard one is replaced, so a message of a replaced source may be accepted again.
+ */
+template <size_t Window = MESH_CORE_DUP_WINDOW_SIZE, size_t Sources = MESH_CORE_DUP_SOURCE_NUM>
+class dup_filter : noncopyable {
+ public:
+  static const bool Direct = sizeof(addr_t) == 1;
+  static const size_t WindowSize = Window;
+  static const size_t SourceNum = Direct ? size_t(1) << (sizeof(addr_t) * 8) : Sources;
+  static const size_t Ways = Direct ? 1 : 4;
+  static_assert(SourceNum > 0 && SourceNum % Ways == 0, "dup source num should be multiple of ways");
+  static_assert(WindowSize % 32 == 0, "window size should be multiple of 32");
+  static_assert(WindowSize <= (size_t(1) << (sizeof(seq_t) * 8 - 1)), "window size should <= half of seq range");
+
+ public:
+  /**
+   * @param expired_ms an older ts than this is taken as the source rebooted
+   * @return true if message is new, and record it
+   */
+  bool check_and_put(addr_t src, seq_t seq, timestamp_t ts, uint32_t expired_ms = MESH_CORE_DUP_EXPIRED_MS) {
+    record& r = find(src);
+    if (!r.valid) {
+      reset(r, seq, ts);
+      return true;
+    }
+
+    auto diff = (int)(seq_diff_t)(seq_t)(seq - r.seq);
+    auto ts_diff = (int32_t)(ts - r.ts);
+    if (diff > 0) {
+      shift(r, (size_t)diff);
+      r.window[0] |= 1u;
+      r.seq = seq;
+      r.ts = ts;
+      return true;
+    }
+
+    if (diff == 0 && ts_diff == 0) {
+      return false;
+    }
+
+    // not newer but created later, or too old to be in flight: source rebooted
+    if (ts_diff > 0 || ts_diff < -(int32_t)expired_ms) {
+      reset(r, seq, ts);
+      return true;
+    }
+
+    auto k = (size_t)(-diff);
+    if (k >= WindowSize) {
+      return false;
+    }
+    uint32_t& word = r.window[k / 32];
+    uint32_t mask = 1u << (k % 32);
+    if (word & mask) {
+      return false;
+    }
+    word |= mask;
+    return true;
+  }
+
+  void clear() {
+    for (auto& r : records_) {
+      r.valid = false;
+    }
+  }
+
+  /**
+   * @return sources recorded
+   */
+  size_t size() const {
+    size_t n = 0;
+    for (const auto& r : records_) {
+      if (r.valid) ++n;
+    }
+    return n;
+  }
+
+ private:
+  using seq_diff_t = typename std::make_signed<seq_t>::type;
+  static const size_t WordNum = WindowSize / 32;
+
+  struct record {
+    uint32_t window[WordNum];
+    timestamp_t ts;
+    seq_t seq;
+    bool valid;
+  };
+
+  struct tag {
+    uint32_t heard;  // local tick, for replacement
+    addr_t src;
+  };
+
+  /**
+   * @return record of src, invalid if new
+   */
+  record& find(addr_t src) {
+    if (Direct) return records_[src];
+    ++tick_;
+    size_t first = ((size_t)src ^ ((size_t)src >> 7)) % (SourceNum / Ways) * Ways;
+    size_t victim = first;
+    for (size_t i = first; i < first + Ways; ++i) {
+      if (!records_[i].valid) {
+        if (records_[victim].valid) victim = i;
+        continue;
+      }
+      if (tags_[i].src == src) {
+        tags_[i].heard = tick_;
+        return records_[i];
+      }
+      if (records_[victim].valid && (int32_t)(tags_[i].heard - tags_[victim].heard) < 0) victim = i;
+    }
+    records_[victim].valid = false;
+    tags_[victim].src = src;
+    tags_[victim].heard = tick_;
+    return records_[victim];
+  }
+
+  static void reset(record& r, seq_t seq, timestamp_t ts) {
+    for (auto& w : r.window) {
+      w = 0;
+    }
+    r.window[0] = 1u;
+    r.seq = seq;
+    r.ts = ts;
+    r.valid = true;
+  }
+
+  static void shift(record& r, size_t n) {
+    if (n >= WindowSize) {
+      for (auto& w : r.window) {
+        w = 0;
+      }
+      return;
+    }
+    size_t word_shift = n / 32;
+    size_t bit_shift = n % 32;
+    for (size_t i = WordNum; i-- > 0;) {
+      uint32_t v = 0;
+      if (i >= word_shift) {
+        v = r.window[i - word_shift] << bit_shift;
+        if (bit_shift && i > word_shift) {
+          v |= r.window[i - word_shift - 1] >> (32 - bit_shift);
+        }
+      }
+      r.window[i] = v;
+    }
+  }
+
+ private:
+  record records_[SourceNum]{};
+  tag tags_[Direct ? 1 : SourceNum]{};
+  uint32_t tick_{};
+};
+
+}  // namespace detail
+}  // namespace mesh_core
@@ -0,0 +1,121 @@
+#pragma once
+
+// config
+#include "../config.hpp"
+#include "../data_view.hpp"
+#include "noncopyable.hpp"
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace mesh_core {
+namespace detail {
+
+/**
+ * fixed-capacity frame storage for pending transmissions, memory is known at link time.
+ *
+ * 1. `SlotNum` slots of `SlotSize` bytes, data is copied in
+ * 2. when full: reject the new frame(Policy 0), or evict the oldest one(Policy 1), see MESH_CORE_FRAME_POOL_POLICY
+ * 3. a `handle` is invalid after released or evicted
+ */
+template <size_t SlotSize, size_t SlotNum = MESH_CORE_FRAME_POOL_NUM, int Policy = MESH_CORE_FRAME_POOL_POLICY>
+class frame_pool : noncopyable {
+ public:
+  static const size_t Capacity = SlotNum;
+  static_assert(SlotNum > 0 && SlotNum < 0xFFFF, "frame pool num error");
+  static_assert(SlotSize <= 0xFFFF, "frame pool slot size error");
+
+  enum class result : uint8_t {
+    ok,
+    evicted,  // ok, but the oldest frame is dropped
+    full,
+    too_large,
+  };
+
+  struct handle {
+    uint16_t index;
+    uint16_t gen;
+  };
+
+ public:
+  result alloc(data_view data, handle& h) {
+    if (data.size() > SlotSize) return result::too_large;
+    result ret = result::ok;
+    size_t index = Capacity;
+    size_t oldest = Capacity;
+    for (size_t i = 0; i < Capacity; ++i) {
+      const auto& slot = slots_[i];
+      if (!slot.used) {
+        index = i;
+        break;
+      }
+      if (oldest == Capacity || (int32_t)(slot.order - slots_[oldest].order) < 0) {
+        oldest = i;
+      }
+    }
+    if (index == Capacity) {
+      if (Policy == 0) return result::full;
+      index = oldest;
+      release(slots_[index]);
+      ret = result::evicted;
+    }
+
+    auto& slot = slots_[index];
+    slot.used = true;
+    slot.order = order_++;
+    slot.size = (uint16_t)data.size();
+    memcpy(slot.data, data.data(), data.size());
+    ++size_;
+    h.index = (uint16_t)index;
+    h.gen = slot.gen;
+    return ret;
+  }
+
+  /**
+   * @return false if released or evicted
+   */
+  bool get(handle h, data_view& data) const {
+    if (!valid(h)) return false;
+    const auto& slot = slots_[h.index];
+    data = data_view(slot.data, slot.size);
+    return true;
+  }
+
+  bool valid(handle h) const {
+    return h.index < Capacity && slots_[h.index].used && slots_[h.index].gen == h.gen;
+  }
+
+  void release(handle h) {
+    if (!valid(h)) return;
+    release(slots_[h.index]);
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+ private:
+  struct slot_t {
+    uint8_t data[SlotSize];
+    uint32_t order;
+    uint16_t size;
+    uint16_t gen;
+    bool used;
+  };
+
+  void release(slot_t& slot) {
+    slot.used = false;
+    ++slot.gen;
+    --size_;
+  }
+
+ private:
+  slot_t slots_[Capacity]{};
+  uint32_t order_{};
+  size_t size_{};
+};
+
+}  // namespace detail
+}  // namespace mesh_core
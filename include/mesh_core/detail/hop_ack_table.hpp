@@ -0,0 +1,107 @@
+#pragma once
+
+// config
+#include "../config.hpp"
+#include "../data_view.hpp"
+#include "../type.hpp"
+#include "frame_pool.hpp"
+#include "noncopyable.hpp"
+#include "timer_wheel.hpp"
+
+// std
+#include <cstddef>
+#include <cstdint>
+
+namespace mesh_core {
+namespace detail {
+
+/**
+ * frames sent to a next hop and waiting for it to forward them, the forward overheard is the ack.
+ *
+ * 1. a copy of the whole frame is kept, retransmission sends the same frame(same uuid)
+ * 2. the next hop forwards with ttl - 1, any copy with the same uuid and a smaller ttl is an ack
+ * 3. when full, new frames are not tracked
+ */
+template <size_t FrameSize, size_t Num = MESH_CORE_HOP_ACK_NUM>
+class hop_ack_table : noncopyable {
+  using pool_t = frame_pool<FrameSize, Num, 0>;
+
+ public:
+  static const size_t Capacity = Num;
+
+  struct entry {
+    typename pool_t::handle frame;
+    timer_wheel::id_t timer;
+    msg_uuid_t uuid;
+    addr_t next_hop;
+    ttl_t ttl;
+    uint8_t type;
+    uint8_t tries;
+    bool used;
+  };
+
+ public:
+  /**
+   * @return index, -1 if full
+   */
+  int add(msg_uuid_t uuid, ttl_t ttl, addr_t next_hop, uint8_t type, data_view frame) {
+    if (pool_.size() == Capacity || frame.size() > FrameSize) return -1;
+    int i = 0;
+    while (entries_[i].used) ++i;
+    auto& e = entries_[i];
+    pool_.alloc(frame, e.frame);
+    e.timer = 0;
+    e.uuid = uuid;
+    e.next_hop = next_hop;
+    e.ttl = ttl;
+    e.type = type;
+    e.tries = 0;
+    e.used = true;
+    return i;
+  }
+
+  /**
+   * @return index, -1 if not found
+   */
+  int find(msg_uuid_t uuid) const {
+    if (pool_.size() == 0) return -1;
+    for (size_t i = 0; i < Capacity; ++i) {
+      if (entries_[i].used && entries_[i].uuid == uuid) return (int)i;
+    }
+    return -1;
+  }
+
+  /**
+   * a copy is heard
+   * @return index of the acked entry, -1 if none
+   */
+  int on_copy(msg_uuid_t uuid, ttl_t ttl) const {
+    int i = find(uuid);
+    return i >= 0 && ttl < entries_[i].ttl ? i : -1;
+  }
+
+  entry& at(int i) {
+    return entries_[i];
+  }
+
+  bool frame(int i, data_view& frame) const {
+    return pool_.get(entries_[i].frame, frame);
+  }
+
+  void release(int i) {
+    auto& e = entries_[i];
+    pool_.release(e.frame);
+    e.used = false;
+  }
+
+  size_t size() const {
+    return pool_.size();
+  }
+
+ private:
+  pool_t pool_;
+  entry entries_[Capacity]{};
+};
+
+}  // namespace detail
+}  // namespace mesh_core
@@ -0,0 +1,52 @@
+#pragma once
+
+// config
+#include "../type.hpp"
+
+// std
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+namespace mesh_core {
+namespace detail {
+
+/**
+ * optional methods of Impl
+ */
+template <typename Impl, typename = void>
+struct has_run_delay : std::false_type {};
+
+template <typename Impl>
+struct has_run_delay<Impl, decltype(std::declval<Impl&>().run_delay(std::declval<std::function<void()>>(), uint32_t()), void())> : std::true_type {};
+
+template <typename Impl, typename = void>
+struct has_airtime : std::false_type {};
+
+template <typename Impl>
+struct has_airtime<Impl, decltype(std::declval<Impl&>().airtime_us(size_t()), void())> : std::true_type {};
+
+template <typename Impl, typename = void>
+struct has_tx_done : std::false_type {};
+
+template <typename Impl>
+struct has_tx_done<Impl, decltype(std::declval<Impl&>().set_tx_done_handle(std::declval<tx_done_handle_t>()), void())> : std::true_type {};
+
+/**
+ * Impl with `InterfaceNum` has indexed interfaces:
+ * `broadcast(iface_t, data_view)` and `set_recv_handle(iface_t, recv_handle_t)`
+ */
+template <typename Impl, typename = void>
+struct has_interfaces : std::false_type {};
+
+template <typename Impl>
+struct has_interfaces<Impl, decltype((void)Impl::InterfaceNum, void())> : std::true_type {};
+
+template <typename Impl, bool = has_interfaces<Impl>::value>
+struct interface_num : std::integral_constant<iface_t, 1> {};
+
+template <typename Impl>
+struct interface_num<Impl, true> : std::integral_constant<iface_t, Impl::InterfaceNum> {};
+
+}  // namespace detail
+}  // namespace mesh_core
@@ -0,0 +1,133 @@
+#pragma once
+
+// config
+#include "../config.hpp"
+
+// std
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace mesh_core {
+namespace detail {
+
+template <typename Signature, size_t Capacity = MESH_CORE_FUNCTION_CAPACITY>
+class inplace_function;
+
+/**
+ * move-only `std::function` with fixed inline storage, never allocates.
+ *
+ * 1. the callable is stored in place, compile error if it is bigger than `Capacity`
+ * 2. two function pointers instead of a virtual table, one indirect call to invoke
+ */
+template <typename R, typename... Args, size_t Capacity>
+class inplace_function<R(Args...), Capacity> {
+  static const size_t Align = alignof(std::max_align_t);
+  using storage_t = typename std::aligned_storage<Capacity, Align>::type;
+  using invoke_t = R (*)(void*, Args&&...);
+  // move `src` to `dst` and destroy `src`, or only destroy `dst` if `src` is nullptr
+  using manage_t = void (*)(void* dst, void* src);
+
+  template <typename F>
+  using enable_if_callable = typename std::enable_if<!std::is_same<typename std::decay<F>::type, inplace_function>::value &&
+                                                     (std::is_void<R>::value ||
+                                                      std::is_convertible<typename std::result_of<F&(Args...)>::type, R>::value)>::type;
+
+ public:
+  inplace_function() noexcept = default;
+
+  inplace_function(std::nullptr_t) noexcept {}
+
+  template <typename F, typename = enable_if_callable<F>>
+  inplace_function(F&& f) {
+    using T = typename std::decay<F>::type;
+    static_assert(sizeof(T) <= Capacity, "callable too large, increase MESH_CORE_FUNCTION_CAPACITY");
+    static_assert(Align % alignof(T) == 0, "callable alignment not supported");
+    new (&storage_) T(std::forward<F>(f));
+    invoke_ = &invoke<T>;
+    manage_ = &manage<T>;
+  }
+
+  inplace_function(inplace_function&& other) noexcept {
+    move_from(other);
+  }
+
+  inplace_function& operator=(inplace_function&& other) noexcept {
+    if (this != &other) {
+      reset();
+      move_from(other);
+    }
+    return *this;
+  }
+
+  inplace_function& operator=(std::nullptr_t) noexcept {
+    reset();
+    return *this;
+  }
+
+  inplace_function(const inplace_function&) = delete;
+  inplace_function& operator=(const inplace_function&) = delete;
+
+  ~inplace_function() {
+    reset();
+  }
+
+  explicit operator bool() const noexcept {
+    return invoke_ != nullptr;
+  }
+
+  R operator()(Args... args) const {
+    return invoke_(const_cast<storage_t*>(&storage_), std::forward<Args>(args)...);
+  }
+
+ private:
+  template <typename T>
+  static R invoke(void* f, Args&&... args) {
+    return static_cast<R>((*static_cast<T*>(f))(std::forward<Args>(args)...));
+  }
+
+  template <typename T>
+  static void manage(void* dst, void* src) {
+    if (src) {
+      new (dst) T(std::move(*static_cast<T*>(src)));
+      static_cast<T*>(src)->~T();
+    } else {
+      static_cast<T*>(dst)->~T();
+    }
+  }
+
+  void move_from(inplace_function& other) noexcept {
+    if (!other.invoke_) return;
+    other.manage_(&storage_, &other.storage_);
+    invoke_ = other.invoke_;
+    manage_ = other.manage_;
+    other.invoke_ = nullptr;
+    other.manage_ = nullptr;
+  }
+
+  void reset() noexcept {
+    if (!invoke_) return;
+    manage_(&storage_, nullptr);
+    invoke_ = nullptr;
+    manage_ = nullptr;
+  }
+
+ private:
+  storage_t storage_;
+  invoke_t invoke_ = nullptr;
+  manage_t manage_ = nullptr;
+};
+
+template <typename Signature, size_t Capacity>
+bool operator==(const inplace_function<Signature, Capacity>& f, std::nullptr_t) noexcept {
+  return !f;
+}
+
+template <typename Signature, size_t Capacity>
+bool operator!=(const inplace_function<Signature, Capacity>& f, std::nullptr_t) noexcept {
+  return (bool)f;
+}
+
+}  // namespace detail
+}  // namespace mesh_core
@@ -0,0 +1,140 @@
+#pragma once
+
+// config
+#include "../config.hpp"
+#include "../type.hpp"
+#include "bitmap.hpp"
+#include "noncopyable.hpp"
+
+// std
+#include <cstddef>
+#include <cstdint>
+
+namespace mesh_core {
+namespace detail {
+
+/**
+ * multipoint relay selection, like OLSR(RFC 3626).
+ *
+ * 1. two hop neighbors are learned from neighbors' one hop routes in route_info
+ * 2. select a small set of one hop neighbors(MPR) which covers all two hop neighbors, by greedy
+ * 3. neighbors know they are selected from the MPR flag in our route_info, we are their `selector`
+ * 4. a broadcast is only relayed by the MPRs of the last hop
+ *
+ * memory: about 8K bytes for 8bit address, a template so it is only checked if an instance enables MPR
+ */
+template <typename Addr = addr_t>
+class basic_mpr_selector : noncopyable {
+ public:
+  static const size_t Capacity = size_t(1) << (sizeof(Addr) * 8);
+  static_assert(sizeof(Addr) == 1, "mpr only for 8bit address");
+  using addr_set = bitmap<Capacity>;
+
+ public:
+  /**
+   * one hop neighbor of `neighbor`
+   */
+  void set_two_hop(addr_t neighbor, addr_t dst, bool linked) {
+    auto& set = two_hop_[neighbor];
+    if (set.test(dst) == linked) return;
+    if (linked) {
+      set.set(dst);
+    } else {
+      set.reset(dst);
+    }
+    dirty_ = true;
+  }
+
+  /**
+   * `src` select us as its MPR or not
+   */
+  void set_selector(addr_t src, bool selected) {
+    if (selected) {
+      selectors_.set(src);
+    } else {
+      selectors_.reset(src);
+    }
+  }
+
+  bool is_selector(addr_t src) const {
+    return selectors_.test(src);
+  }
+
+  bool is_mpr(addr_t neighbor) const {
+    return mpr_.test(neighbor);
+  }
+
+  /**
+   * select MPR set, only if neighbors or two hop neighbors changed
+   * @param neighbors one hop neighbors
+   * @param changed neighbors whose MPR state changed
+   * @return false if no need to update
+   */
+  bool update(const addr_set& neighbors, addr_t self, addr_set& changed) {
+    if (!dirty_ && neighbors == neighbors_) return false;
+    dirty_ = false;
+    neighbors_ = neighbors;
+
+    // strict two hop neighbors
+    addr_set two_hop;
+    for (size_t n = neighbors.find_next(0); n < Capacity; n = neighbors.find_next(n + 1)) {
+      two_hop |= two_hop_[n];
+    }
+    two_hop.remove(neighbors);
+    two_hop.reset(self);
+
+    // neighbors which is the only one to reach some two hop neighbor
+    addr_set mpr;
+    for (size_t x = two_hop.find_next(0); x < Capacity; x = two_hop.find_next(x + 1)) {
+      size_t only = Capacity;
+      for (size_t n = neighbors.find_next(0); n < Capacity; n = neighbors.find_next(n + 1)) {
+        if (!two_hop_[n].test(x)) continue;
+        if (only != Capacity) {
+          only = Capacity;
+          break;
+        }
+        only = n;
+      }
+      if (only != Capacity) mpr.set(only);
+    }
+
+    addr_set uncovered = two_hop;
+    for (size_t n = mpr.find_next(0); n < Capacity; n = mpr.find_next(n + 1)) {
+      uncovered.remove(two_hop_[n]);
+    }
+
+    // greedy: the one covers most uncovered
+    while (uncovered.any()) {
+      size_t best = Capacity;
+      size_t best_count = 0;
+      for (size_t n = neighbors.find_next(0); n < Capacity; n = neighbors.find_next(n + 1)) {
+        if (mpr.test(n)) continue;
+        size_t count = two_hop_[n].count_common(uncovered);
+        if (count > best_count) {
+          best = n;
+          best_count = count;
+        }
+      }
+      if (best == Capacity) break;
+      mpr.set(best);
+      uncovered.remove(two_hop_[best]);
+    }
+
+    changed = mpr;
+    changed ^= mpr_;
+    mpr_ = mpr;
+    return true;
+  }
+
+ private:
+  addr_set two_hop_[Capacity];
+  addr_set neighbors_;
+  addr_set mpr_;
+  addr_set selectors_;
+  bool dirty_{};
+};
+
+using mpr_selector = basic_mpr_selector<>;
+
+}  // namespace detail
+}  // namespace mesh_core
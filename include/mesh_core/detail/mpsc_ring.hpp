@@ -0,0 +1,110 @@
+#pragma once
+
+// config
+#include "noncopyable.hpp"
+
+// std
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace mesh_core {
+namespace detail {
+
+/**
+ * bounded lock-free multi-producer single-consumer ring, like Vyukov's bounded queue.
+ *
+ * 1. each cell has a sequence: `pos` if free for the producer at `pos`, `pos + 1` if filled
+ * 2. producers claim a position by CAS on head, fill the cell in place, then publish it by the cell sequence
+ * 3. the consumer reads in order, a claimed but not yet published cell stops it, so the order is kept
+ * 4. no heap allocation, values are filled and consumed in place
+ */
+template <typename T, size_t Num>
+class mpsc_ring : noncopyable {
+ public:
+  static const size_t Capacity = Num;
+  static_assert(Num >= 2 && (Num & (Num - 1)) == 0, "ring size should be power of 2");
+
+ public:
+  mpsc_ring() {
+    for (size_t i = 0; i < Capacity; ++i) {
+      cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  /**
+   * any thread
+   * @param fill void(T&), called at most once
+   * @return false if full
+   */
+  template <typename Fill>
+  bool push(Fill&& fill) {
+    size_t pos = head_.load(std::memory_order_relaxed);
+    cell* c;
+    for (;;) {
+      c = &cells_[pos & (Capacity - 1)];
+      size_t seq = c->seq.load(std::memory_order_acquire);
+      auto diff = (intptr_t)seq - (intptr_t)pos;
+      if (diff == 0) {
+        if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = head_.load(std::memory_order_relaxed);
+      }
+    }
+    fill(c->value);
+    c->seq.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * consumer thread only
+   * @param consume void(T&)
+   * @return false if empty
+   */
+  template <typename Consume>
+  bool pop(Consume&& consume) {
+    cell& c = cells_[tail_ & (Capacity - 1)];
+    if (c.seq.load(std::memory_order_acquire) != tail_ + 1) return false;
+    consume(c.value);
+    c.seq.store(tail_ + Capacity, std::memory_order_release);
+    ++tail_;
+    return true;
+  }
+
+  /**
+   * claimed cells, may be stale
+   */
+  size_t size_approx() const {
+    size_t head = head_.load(std::memory_order_relaxed);
+    size_t tail = tail_read_.load(std::memory_order_relaxed);
+    return head - tail;
+  }
+
+  /**
+   * consumer thread only, publish the tail for `size_approx()`
+   */
+  void sync_tail() {
+    tail_read_.store(tail_, std::memory_order_relaxed);
+  }
+
+ private:
+  struct cell {
+    std::atomic<size_t> seq;
+    T value;
+  };
+
+  static const size_t CacheLine = 64;
+
+  // producers and the consumer on separate cache lines
+  std::atomic<size_t> head_{0};
+  char pad0_[CacheLine - sizeof(std::atomic<size_t>)];
+  size_t tail_{0};
+  std::atomic<size_t> tail_read_{0};
+  char pad1_[CacheLine - sizeof(size_t) - sizeof(std::atomic<size_t>)];
+  cell cells_[Capacity];
+};
+
+}  // namespace detail
+}  // namespace mesh_core
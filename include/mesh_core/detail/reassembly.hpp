@@ -0,0 +1,160 @@
+#pragma once
+
+// config
+#include "../config.hpp"
+#include "../data_view.hpp"
+#include "../type.hpp"
+#include "bitmap.hpp"
+#include "copyable.hpp"
+#include "noncopyable.hpp"
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace mesh_core {
+
+#pragma pack(1)
+struct fragment_msg : detail::copyable {
+  uint8_t id{};      // transfer id, per source
+  uint16_t index{};  // data offset: index * fragment size
+  uint16_t count{};  // all fragments except the last one are full
+};
+#pragma pack()
+
+namespace detail {
+
+/**
+ * bounded reassembly of large payloads, memory is known at link time.
+ *
+ * 1. one slot per payload(src, id), a bitmap tracks received fragments, so out of order and duplicates are fine
+ * 2. data is copied into the slot only if `store`, streaming receivers need no buffer
+ * 3. incomplete payload is dropped after `timeout_ms`(MESH_CORE_REASSEMBLY_TIMEOUT_MS) idle, or replaced by a newer one from the same source
+ */
+template <size_t FragmentSize, size_t SlotNum = MESH_CORE_REASSEMBLY_NUM, size_t BufferSize = MESH_CORE_REASSEMBLY_SIZE>
+class reassembly : noncopyable {
+ public:
+  static const size_t Capacity = SlotNum;
+  static const size_t FragmentNumMax = MESH_CORE_FRAGMENT_NUM_MAX;
+  static_assert(SlotNum > 0, "reassembly num error");
+  static_assert(FragmentNumMax > 0 && FragmentNumMax <= 0xFFFF, "fragment num error");
+
+  enum class result : uint8_t {
+    ok,
+    complete,  // all fragments received
+    duplicate,
+    error,      // bad fragment header
+    full,       // no free slot
+    too_large,  // exceed BufferSize
+  };
+
+ public:
+  /**
+   * @param store copy data into the slot
+   * @param payload the whole payload if complete and `store`, valid until the next `add()`
+   * @param dropped add number of dropped incomplete payloads
+   */
+  result add(timestamp_t now, addr_t src, const fragment_msg& frag, data_view data, bool store, data_view& payload, uint32_t& dropped,
+             uint32_t timeout_ms = MESH_CORE_REASSEMBLY_TIMEOUT_MS) {
+    if (frag.count == 0 || frag.count > FragmentNumMax || frag.index >= frag.count || data.size() > FragmentSize) return result::error;
+    bool last = frag.index + 1 == frag.count;
+    if (!last && data.size() != FragmentSize) return result::error;
+    expire(now, dropped, timeout_ms);
+
+    size_t offset = (size_t)frag.index * FragmentSize;
+    slot_t* slot = find(src, frag.id, dropped);
+    if (slot == nullptr) {
+      // the smallest possible payload should fit
+      if (store && (size_t)(frag.count - 1) * FragmentSize + 1 > BufferSize) return result::too_large;
+      slot = alloc();
+      if (slot == nullptr) return result::full;
+      slot->used = true;
+      slot->src = src;
+      slot->id = frag.id;
+      slot->count = frag.count;
+      slot->num = 0;
+      slot->size = 0;
+      slot->received.clear();
+    } else if (slot->count != frag.count) {
+      return result::error;
+    }
+    if (slot->received.test(frag.index)) return result::duplicate;
+
+    if (store) {
+      if (offset + data.size() > BufferSize) {
+        slot->used = false;
+        ++dropped;
+        return result::too_large;
+      }
+      memcpy(slot->buffer + offset, data.data(), data.size());
+      if (last) slot->size = offset + data.size();
+    }
+    slot->received.set(frag.index);
+    slot->ts = now;
+    if (++slot->num < slot->count) return result::ok;
+
+    payload = data_view(slot->buffer, slot->size);
+    slot->used = false;
+    return result::complete;
+  }
+
+  /**
+   * @param dropped add number of dropped incomplete payloads
+   * @param timeout_ms idle time of an incomplete payload
+   */
+  void expire(timestamp_t now, uint32_t& dropped, uint32_t timeout_ms = MESH_CORE_REASSEMBLY_TIMEOUT_MS) {
+    for (auto& slot : slots_) {
+      if (slot.used && now - slot.ts > timeout_ms) {
+        slot.used = false;
+        ++dropped;
+      }
+    }
+  }
+
+  size_t size() const {
+    size_t n = 0;
+    for (const auto& slot : slots_) {
+      if (slot.used) ++n;
+    }
+    return n;
+  }
+
+ private:
+  struct slot_t {
+    uint8_t buffer[BufferSize ? BufferSize : 1];
+    bitmap<FragmentNumMax> received;
+    size_t size;
+    timestamp_t ts;
+    uint16_t count;
+    uint16_t num;
+    addr_t src;
+    uint8_t id;
+    bool used;
+  };
+
+  slot_t* find(addr_t src, uint8_t id, uint32_t& dropped) {
+    for (auto& slot : slots_) {
+      if (!slot.used || slot.src != src) continue;
+      if (slot.id == id) return &slot;
+      // the source sends one payload at a time
+      slot.used = false;
+      ++dropped;
+      return nullptr;
+    }
+    return nullptr;
+  }
+
+  slot_t* alloc() {
+    for (auto& slot : slots_) {
+      if (!slot.used) return &slot;
+    }
+    return nullptr;
+  }
+
+ private:
+  slot_t slots_[Capacity]{};
+};
+
+}  // namespace detail
+}  // namespace mesh_core
@@ -0,0 +1,104 @@
+#pragma once
+
+// config
+#include "../config.hpp"
+#include "../type.hpp"
+#include "noncopyable.hpp"
+
+// std
+#include <cstddef>
+#include <cstdint>
+
+namespace mesh_core {
+namespace detail {
+
+/**
+ * pending rebroadcasts, for counter-based broadcast storm suppression.
+ *
+ * a rebroadcast is delayed randomly, copies of the same message heard during the delay are counted,
+ * it is cancelled if enough copies heard, or a copy with much better lqs heard(the neighbor is close and covers us).
+ *
+ * the delayed task holds a `handle`, it is invalid after cancelled.
+ */
+template <size_t Num = MESH_CORE_REBROADCAST_PENDING_NUM>
+class rebroadcast_table : noncopyable {
+ public:
+  static const size_t Capacity = Num;
+
+  struct handle {
+    uint16_t index;
+    uint16_t gen;
+  };
+
+ public:
+  /**
+   * @return false if full, the rebroadcast can not be cancelled
+   */
+  bool add(addr_t src, seq_t seq, lqs_t lqs, handle& h) {
+    for (size_t i = 0; i < Capacity; ++i) {
+      auto& item = items_[i];
+      if (item.valid) continue;
+      item.valid = true;
+      item.src = src;
+      item.seq = seq;
+      item.lqs = lqs;
+      item.copies = 1;
+      h.index = (uint16_t)i;
+      h.gen = item.gen;
+      return true;
+    }
+    return false;
+  }
+
+  /**
+   * a copy of message heard
+   * @param threshold copies to cancel, 0 for disable
+   * @param lqs_margin cancel if the copy is better than the first one by this margin
+   * @return true if the pending rebroadcast is cancelled
+   */
+  bool on_copy(addr_t src, seq_t seq, lqs_t lqs, uint8_t threshold = MESH_CORE_REBROADCAST_COUNTER_THRESHOLD,
+               int lqs_margin = MESH_CORE_REBROADCAST_LQS_MARGIN) {
+    for (auto& item : items_) {
+      if (!item.valid || item.src != src || item.seq != seq) continue;
+      ++item.copies;
+      if ((threshold && item.copies >= threshold) || (int)lqs - (int)item.lqs >= lqs_margin) {
+        release(item);
+        return true;
+      }
+      return false;
+    }
+    return false;
+  }
+
+  /**
+   * called when the delayed task run
+   * @return false if cancelled
+   */
+  bool take(handle h) {
+    auto& item = items_[h.index];
+    if (!item.valid || item.gen != h.gen) return false;
+    release(item);
+    return true;
+  }
+
+ private:
+  struct item_t {
+    uint16_t gen;
+    addr_t src;
+    seq_t seq;
+    lqs_t lqs;
+    uint8_t copies;
+    bool valid;
+  };
+
+  static void release(item_t& item) {
+    item.valid = false;
+    ++item.gen;
+  }
+
+ private:
+  item_t items_[Capacity]{};
+};
+
+}  // namespace detail
+}  // namespace mesh_core
@@ -0,0 +1,357 @@
+#pragma once
+
+// config
+#include "../config.hpp"
+#include "../data_view.hpp"
+#include "../type.hpp"
+#include "copyable.hpp"
+#include "frame_pool.hpp"
+#include "noncopyable.hpp"
+#include "timer_wheel.hpp"
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace mesh_core {
+
+#pragma pack(1)
+struct reliable_msg : detail::copyable {
+  static const uint8_t FlagSyn = 0x01;  // sender has no ack yet, receiver may reset its window to base
+
+  uint8_t seq{};   // per destination
+  uint8_t base{};  // oldest unacked of sender, older ones are acked or given up
+  uint8_t flags{};
+};
+
+struct ack_msg : detail::copyable {
+  uint8_t cum{};          // next expected seq, all before it are received
+  uint32_t sack{};        // bit i: seq `cum + 1 + i` is received
+  timestamp_t echo_ts{};  // ts of the acked frame, for rtt
+};
+#pragma pack()
+
+namespace detail {
+
+inline bool seq8_before(uint8_t a, uint8_t b) {
+  return (int8_t)(a - b) < 0;
+}
+
+/**
+ * retransmission timeout from rtt samples, like TCP(RFC 6298) in ms
+ */
+class rtt_estimator {
+ public:
+  void update(uint32_t rtt) {
+    if (!valid_) {
+      srtt_ = rtt;
+      rttvar_ = rtt / 2;
+      valid_ = true;
+      return;
+    }
+    uint32_t err = srtt_ > rtt ? srtt_ - rtt : rtt - srtt_;
+    rttvar_ = (3 * rttvar_ + err) / 4;
+    srtt_ = (7 * srtt_ + rtt) / 8;
+  }
+
+  /**
+   * @param init_ms before the first sample
+   */
+  uint32_t rto(uint32_t init_ms = MESH_CORE_RELIABLE_RTO_INIT_MS, uint32_t min_ms = MESH_CORE_RELIABLE_RTO_MIN_MS,
+               uint32_t max_ms = MESH_CORE_RELIABLE_RTO_MAX_MS) const {
+    if (!valid_) return init_ms;
+    uint32_t rto = srtt_ + 4 * rttvar_;
+    if (rto < min_ms) return min_ms;
+    if (rto > max_ms) return max_ms;
+    return rto;
+  }
+
+  uint32_t srtt() const {
+    return srtt_;
+  }
+
+  void reset() {
+    valid_ = false;
+  }
+
+ private:
+  uint32_t srtt_{};
+  uint32_t rttvar_{};
+  bool valid_{};
+};
+
+/**
+ * receive window of each source, messages are delivered once but not in order, so no buffer is needed
+ */
+template <size_t PeerNum = MESH_CORE_RELIABLE_PEER_NUM>
+class reliable_rx : noncopyable {
+ public:
+  static const int SackBits = 32;
+
+  /**
+   * @param ack filled with the state after this message, except `echo_ts`
+   * @return true if the message is new
+   */
+  bool on_data(timestamp_t now, addr_t src, const reliable_msg& msg, ack_msg& ack) {
+    peer_t* p = find(src);
+    int off = p ? (int8_t)(msg.seq - p->cum) : 0;
+    if (p == nullptr || ((msg.flags & reliable_msg::FlagSyn) && (off < -SackBits || off > SackBits))) {
+      // new source, or the source restarted
+      if (p == nullptr) p = alloc();
+      p->used = true;
+      p->src = src;
+      p->cum = msg.base;
+      p->sack = 0;
+    }
+    p->ts = now;
+
+    // the source gave up messages before base
+    while (seq8_before(p->cum, msg.base)) {
+      slide(*p);
+    }
+
+    bool fresh = false;
+    off = (int8_t)(msg.seq - p->cum);
+    if (off == 0) {
+      fresh = true;
+      slide(*p);
+    } else if (off > 0 && off <= SackBits) {
+      uint32_t bit = uint32_t(1) << (off - 1);
+      fresh = !(p->sack & bit);
+      p->sack |= bit;
+    }
+    ack.cum = p->cum;
+    ack.sack = p->sack;
+    return fresh;
+  }
+
+ private:
+  struct peer_t {
+    timestamp_t ts;
+    uint32_t sack;
+    addr_t src;
+    uint8_t cum;
+    bool used;
+  };
+
+  /**
+   * `cum` is received or given up, move to the next missing one
+   */
+  static void slide(peer_t& p) {
+    ++p.cum;
+    while (p.sack & 1) {
+      p.sack >>= 1;
+      ++p.cum;
+    }
+    p.sack >>= 1;
+  }
+
+  peer_t* find(addr_t src) {
+    for (auto& p : peers_) {
+      if (p.used && p.src == src) return &p;
+    }
+    return nullptr;
+  }
+
+  /**
+   * reuse the least recently used one
+   */
+  peer_t* alloc() {
+    peer_t* lru = &peers_[0];
+    for (auto& p : peers_) {
+      if (!p.used) return &p;
+      if ((int32_t)(p.ts - lru->ts) < 0) lru = &p;
+    }
+    return lru;
+  }
+
+ private:
+  peer_t peers_[PeerNum]{};
+};
+
+/**
+ * pending reliable messages, payloads are kept for retransmission.
+ *
+ * 1. sliding window of `Window` seq for each destination, at most `Num` messages pending in total
+ * 2. a message is done when acked by `cum` or `sack`, or given up by the user
+ */
+template <size_t DataSize, size_t Num = MESH_CORE_RELIABLE_TX_NUM, size_t PeerNum = MESH_CORE_RELIABLE_PEER_NUM, size_t Window = MESH_CORE_RELIABLE_WINDOW>
+class reliable_tx : noncopyable {
+  using pool_t = frame_pool<DataSize, Num, 0>;
+
+ public:
+  static const size_t Capacity = Num;
+  static_assert(Num > 0 && Num <= 32, "reliable tx num error");
+  static_assert(Window > 0 && Window <= 32, "reliable window should <= sack bits");
+
+  struct entry {
+    typename pool_t::handle data;
+    send_done_handle_t done;
+    timer_wheel::id_t timer;
+    uint8_t seq;
+    uint8_t peer;
+    uint8_t tries;
+    uint8_t gen;  // changes when the slot is reused
+    bool used;
+  };
+
+ public:
+  /**
+   * @param init_seq first seq if the destination is new
+   * @return index, -1 if window or pool is full
+   */
+  int add(timestamp_t now, addr_t dst, data_view data, uint8_t init_seq) {
+    if (data.size() > DataSize || pool_.size() == Capacity) return -1;
+    int pi = find_peer(dst);
+    if (pi < 0) {
+      pi = alloc_peer();
+      if (pi < 0) return -1;
+      auto& p = peers_[pi];
+      p.used = true;
+      p.synced = false;
+      p.dst = dst;
+      p.next_seq = init_seq;
+      p.rtt.reset();
+    }
+    auto& p = peers_[pi];
+    if ((uint8_t)(p.next_seq - base(pi)) >= Window) return -1;
+
+    int i = 0;
+    while (entries_[i].used) ++i;
+    auto& e = entries_[i];
+    pool_.alloc(data, e.data);
+    e.timer = 0;
+    e.seq = p.next_seq++;
+    e.peer = (uint8_t)pi;
+    e.tries = 0;
+    ++e.gen;
+    e.used = true;
+    p.ts = now;
+    return i;
+  }
+
+  entry& at(int i) {
+    return entries_[i];
+  }
+
+  /**
+   * @return false if not pending
+   */
+  bool frame(int i, addr_t& dst, reliable_msg& msg, data_view& data) const {
+    const auto& e = entries_[i];
+    if (!e.used || !pool_.get(e.data, data)) return false;
+    const auto& p = peers_[e.peer];
+    dst = p.dst;
+    msg.seq = e.seq;
+    msg.base = base(e.peer);
+    msg.flags = p.synced ? 0 : reliable_msg::FlagSyn;
+    return true;
+  }
+
+  /**
+   * @return timeout for the next try, exponential backoff, see `rtt_estimator::rto` for limits
+   */
+  uint32_t rto(int i, uint32_t init_ms = MESH_CORE_RELIABLE_RTO_INIT_MS, uint32_t min_ms = MESH_CORE_RELIABLE_RTO_MIN_MS,
+               uint32_t max_ms = MESH_CORE_RELIABLE_RTO_MAX_MS) const {
+    const auto& e = entries_[i];
+    uint64_t rto = (uint64_t)peers_[e.peer].rtt.rto(init_ms, min_ms, max_ms) << (e.tries > 1 ? e.tries - 1 : 0);
+    return rto > max_ms ? max_ms : (uint32_t)rto;
+  }
+
+  /**
+   * @param rtt by `echo_ts`
+   * @return bit i: entry i is acked, should be released
+   */
+  uint32_t on_ack(timestamp_t now, addr_t src, const ack_msg& ack, uint32_t rtt) {
+    int pi = find_peer(src);
+    if (pi < 0) return 0;
+    auto& p = peers_[pi];
+    p.synced = true;
+    p.ts = now;
+    p.rtt.update(rtt);
+    uint32_t acked = 0;
+    for (size_t i = 0; i < Capacity; ++i) {
+      const auto& e = entries_[i];
+      if (!e.used || e.peer != pi) continue;
+      int off = (int8_t)(e.seq - ack.cum);
+      if (off < 0 || (off > 0 && off <= 32 && (ack.sack >> (off - 1)) & 1)) {
+        acked |= uint32_t(1) << i;
+      }
+    }
+    return acked;
+  }
+
+  void release(int i) {
+    auto& e = entries_[i];
+    pool_.release(e.data);
+    e.done = nullptr;
+    e.used = false;
+  }
+
+  size_t size() const {
+    return pool_.size();
+  }
+
+  /**
+   * @return smoothed rtt to `dst`, 0 if unknown
+   */
+  uint32_t srtt(addr_t dst) const {
+    int pi = find_peer(dst);
+    return pi < 0 ? 0 : peers_[pi].rtt.srtt();
+  }
+
+ private:
+  struct peer_t {
+    rtt_estimator rtt;
+    timestamp_t ts;
+    addr_t dst;
+    uint8_t next_seq;
+    bool synced;
+    bool used;
+  };
+
+  uint8_t base(int pi) const {
+    uint8_t b = peers_[pi].next_seq;
+    for (const auto& e : entries_) {
+      if (e.used && e.peer == pi && seq8_before(e.seq, b)) b = e.seq;
+    }
+    return b;
+  }
+
+  int find_peer(addr_t dst) const {
+    for (size_t i = 0; i < PeerNum; ++i) {
+      if (peers_[i].used && peers_[i].dst == dst) return (int)i;
+    }
+    return -1;
+  }
+
+  /**
+   * reuse the least recently used one without pending messages
+   */
+  int alloc_peer() {
+    int lru = -1;
+    for (size_t i = 0; i < PeerNum; ++i) {
+      const auto& p = peers_[i];
+      if (!p.used) return (int)i;
+      if (pending((int)i)) continue;
+      if (lru < 0 || (int32_t)(p.ts - peers_[lru].ts) < 0) lru = (int)i;
+    }
+    return lru;
+  }
+
+  bool pending(int pi) const {
+    for (const auto& e : entries_) {
+      if (e.used && e.peer == pi) return true;
+    }
+    return false;
+  }
+
+ private:
+  pool_t pool_;
+  entry entries_[Capacity]{};
+  peer_t peers_[PeerNum]{};
+};
+
+}  // namespace detail
+}  // namespace mesh_core
@@ -0,0 +1,274 @@
+#pragma once
+
+// config
+#include "../config.hpp"
+#include "../type.hpp"
+#include "bitmap.hpp"
+#include "inplace_function.hpp"
+#include "noncopyable.hpp"
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace mesh_core {
+namespace detail {
+
+/**
+ * hierarchical timer wheel, like linux kernel timers.
+ *
+ * 1. 4 levels * 64 slots, level n slot spans 64^n ticks
+ * 2. O(1) add and cancel, timer nodes and callbacks are pooled, no allocation
+ * 3. driven by `poll(now)`, `next_timeout(now)` tells when to poll again, for one hardware timer
+ * 4. empty ticks are skipped by the slot bitmap of each level, poll cost does not depend on elapsed time
+ *
+ * @tparam Num timers can be pending at the same time
+ */
+template <size_t Num = MESH_CORE_TIMER_NUM>
+class basic_timer_wheel : noncopyable {
+ public:
+  static const size_t Capacity = Num;
+  static const uint32_t TickMs = MESH_CORE_TIMER_TICK_MS;
+  static_assert(Capacity > 0 && Capacity < 0xFFFF, "timer num error");
+  static_assert(TickMs > 0, "tick error");
+
+  // 0 for invalid
+  using id_t = uint32_t;
+  using callback_t = inplace_function<void()>;
+
+ public:
+  explicit basic_timer_wheel(timestamp_t now = 0) : last_ms_(now) {
+    for (auto& h : heads_) {
+      h = Nil;
+    }
+    for (size_t i = 0; i < Capacity; ++i) {
+      nodes_[i].next = (i + 1 < Capacity) ? (uint16_t)(i + 1) : Nil;
+    }
+    free_ = 0;
+  }
+
+  /**
+   * @param delay_ms max: 2^24 ticks, longer will be truncated
+   * @param period_ms repeat if not 0
+   * @return 0 if no free timer
+   */
+  id_t add(timestamp_t now, uint32_t delay_ms, callback_t cb, uint32_t period_ms = 0) {
+    if (free_ == Nil) return 0;
+    if (size_ == 0) {
+      // idle wheel may be far behind, nothing to run
+      poll(now);
+    }
+    uint16_t i = free_;
+    auto& node = nodes_[i];
+    free_ = node.next;
+    node.active = true;
+    node.cb = std::move(cb);
+    node.period = period_ms ? clamp_ticks(to_ticks(period_ms)) : 0;
+    // count from now, not the last tick
+    node.expires = now_ + clamp_ticks(to_ticks(delay_ms + (now - last_ms_)));
+    insert(i);
+    ++size_;
+    return make_id(i);
+  }
+
+  /**
+   * @return false if not exist or already expired
+   */
+  bool cancel(id_t id) {
+    uint16_t i;
+    if (!find(id, i)) return false;
+    unlink(i);
+    release(i);
+    return true;
+  }
+
+  /**
+   * run expired timers
+   */
+  void poll(timestamp_t now) {
+    uint32_t elapsed = (now - last_ms_) / TickMs;
+    while (elapsed) {
+      uint32_t next = next_ticks();
+      if (next > elapsed) {
+        now_ += elapsed;
+        last_ms_ += elapsed * TickMs;
+        return;
+      }
+      // nothing to do before next
+      now_ += next - 1;
+      last_ms_ += next * TickMs;
+      elapsed -= next;
+      tick();
+    }
+  }
+
+  /**
+   * @return ms to the next poll, may earlier than the real deadline, UINT32_MAX if no timer
+   */
+  uint32_t next_timeout(timestamp_t now) const {
+    uint32_t ticks = next_ticks();
+    if (ticks == UINT32_MAX) return UINT32_MAX;
+    uint32_t elapsed = now - last_ms_;
+    uint32_t ms = ticks * TickMs;
+    return ms > elapsed ? ms - elapsed : 0;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+ private:
+  static const int LevelNum = 4;
+  static const uint32_t SlotBits = 6;
+  static const uint32_t SlotNum = 1u << SlotBits;
+  static const uint32_t SlotMask = SlotNum - 1;
+  static const uint32_t MaxTicks = (1u << (SlotBits * LevelNum)) - 1;
+  static const uint16_t Nil = 0xFFFF;
+
+  struct node_t {
+    callback_t cb;
+    uint32_t expires;
+    uint32_t period;
+    uint16_t prev;
+    uint16_t next;
+    uint16_t slot;
+    uint16_t gen;
+    bool active;
+  };
+
+  static uint32_t to_ticks(uint32_t ms) {
+    return ms / TickMs + (ms % TickMs ? 1 : 0);
+  }
+
+  static uint32_t clamp_ticks(uint32_t ticks) {
+    return ticks == 0 ? 1 : (ticks > MaxTicks ? MaxTicks : ticks);
+  }
+
+  id_t make_id(uint16_t i) const {
+    return ((uint32_t)nodes_[i].gen << 16 | i) + 1;
+  }
+
+  /**
+   * @return ticks to the next tick need to run: a level 0 slot expires, or a higher level slot cascades.
+   * UINT32_MAX if no timer
+   */
+  uint32_t next_ticks() const {
+    if (size_ == 0) return UINT32_MAX;
+    uint32_t ticks = UINT32_MAX;
+    for (int level = 0; level < LevelNum; ++level) {
+      uint64_t bits = occupied_[level];
+      if (!bits) continue;
+      uint32_t shift = level * SlotBits;
+      uint32_t cur = now_ >> shift;
+      // rotate slot (cur + 1) to bit 0
+      uint32_t r = (cur + 1) & SlotMask;
+      if (r) bits = (bits >> r) | (bits << (SlotNum - r));
+      uint32_t d = (uint32_t)ctz64(bits) + 1;
+      uint32_t t = ((cur + d) << shift) - now_;
+      if (t < ticks) ticks = t;
+    }
+    return ticks;
+  }
+
+  bool find(id_t id, uint16_t& i) const {
+    if (id == 0) return false;
+    --id;
+    i = (uint16_t)(id & 0xFFFF);
+    return i < Capacity && nodes_[i].active && nodes_[i].gen == (uint16_t)(id >> 16);
+  }
+
+  /**
+   * expires should in [now_, now_ + MaxTicks], now_ only happen when cascade, and will run in this tick
+   */
+  void insert(uint16_t i) {
+    auto& node = nodes_[i];
+    uint32_t delta = node.expires - now_;
+    int level = 0;
+    while (level < LevelNum - 1 && delta >= (1u << (SlotBits * (level + 1)))) {
+      ++level;
+    }
+    node.slot = (uint16_t)(level * SlotNum + ((node.expires >> (level * SlotBits)) & SlotMask));
+    uint16_t& head = heads_[node.slot];
+    node.prev = Nil;
+    node.next = head;
+    if (head != Nil) nodes_[head].prev = i;
+    head = i;
+    occupied_[node.slot / SlotNum] |= uint64_t(1) << (node.slot & SlotMask);
+  }
+
+  void unlink(uint16_t i) {
+    auto& node = nodes_[i];
+    if (node.prev != Nil) {
+      nodes_[node.prev].next = node.next;
+    } else {
+      heads_[node.slot] = node.next;
+      if (node.next == Nil) occupied_[node.slot / SlotNum] &= ~(uint64_t(1) << (node.slot & SlotMask));
+    }
+    if (node.next != Nil) nodes_[node.next].prev = node.prev;
+  }
+
+  void release(uint16_t i) {
+    auto& node = nodes_[i];
+    node.active = false;
+    node.cb = nullptr;
+    ++node.gen;
+    node.next = free_;
+    free_ = i;
+    --size_;
+  }
+
+  void cascade(int level) {
+    uint16_t slot = (uint16_t)(level * SlotNum + ((now_ >> (level * SlotBits)) & SlotMask));
+    uint16_t i = heads_[slot];
+    heads_[slot] = Nil;
+    occupied_[level] &= ~(uint64_t(1) << (slot & SlotMask));
+    while (i != Nil) {
+      uint16_t next = nodes_[i].next;
+      insert(i);
+      i = next;
+    }
+  }
+
+  void tick() {
+    ++now_;
+    for (int level = 1; level < LevelNum; ++level) {
+      if ((now_ & ((1u << (level * SlotBits)) - 1)) != 0) break;
+      cascade(level);
+    }
+
+    uint16_t& head = heads_[now_ & SlotMask];
+    while (head != Nil) {
+      uint16_t i = head;
+      auto& node = nodes_[i];
+      unlink(i);
+      uint16_t gen = node.gen;
+      if (node.period) {
+        // callback may cancel itself
+        auto cb = std::move(node.cb);
+        node.expires = now_ + node.period;
+        insert(i);
+        cb();
+        if (node.active && node.gen == gen) node.cb = std::move(cb);
+      } else {
+        auto cb = std::move(node.cb);
+        release(i);
+        cb();
+      }
+    }
+  }
+
+ private:
+  node_t nodes_[Capacity]{};
+  uint16_t heads_[LevelNum * SlotNum];
+  uint64_t occupied_[LevelNum]{};  // bit for non-empty slot
+  uint16_t free_;
+  size_t size_{};
+  uint32_t now_{};  // ticks
+  timestamp_t last_ms_;
+};
+
+using timer_wheel = basic_timer_wheel<>;
+
+}  // namespace detail
+}  // namespace mesh_core
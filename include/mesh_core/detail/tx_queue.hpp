@@ -0,0 +1,144 @@
+#pragma once
+
+// config
+#include "../config.hpp"
+#include "../data_view.hpp"
+#include "../type.hpp"
+#include "frame_pool.hpp"
+#include "noncopyable.hpp"
+
+// std
+#include <cstddef>
+#include <cstdint>
+
+namespace mesh_core {
+namespace detail {
+
+/**
+ * bounded transmit queue, drained one frame per tx done of Impl.
+ *
+ * 1. frames are served by priority class, FIFO in the same class
+ * 2. when full, a new frame evicts the newest frame of a lower class, otherwise it is rejected
+ * 3. frames not sent before their deadline are dropped on the way out
+ */
+template <size_t FrameSize, size_t Num = MESH_CORE_TX_QUEUE_NUM>
+class tx_queue : noncopyable {
+  using pool_t = frame_pool<FrameSize, Num, 0>;
+
+ public:
+  static const size_t Capacity = Num;
+  static const int PriorityNum = (int)tx_priority::num;
+
+  enum class result : uint8_t {
+    ok,
+    evicted,  // ok, but a lower priority frame is dropped
+    full,
+    too_large,
+  };
+
+ public:
+  /**
+   * @param tag user data returned by `front()`
+   */
+  result push(tx_priority priority, timestamp_t deadline, data_view frame, uint8_t tag = 0) {
+    if (frame.size() > FrameSize) return result::too_large;
+    result ret = result::ok;
+    if (pool_.size() == Capacity) {
+      if (!evict_lower((int)priority)) return result::full;
+      ret = result::evicted;
+    }
+    auto& q = queues_[(int)priority];
+    auto& item = q.items[(q.head + q.size) % Capacity];
+    pool_.alloc(frame, item.frame);
+    item.deadline = deadline;
+    item.tag = tag;
+    ++q.size;
+    return ret;
+  }
+
+  /**
+   * the next frame to send, valid until `pop()`, expired frames before it are dropped
+   * @param expired add number of dropped frames
+   * @return false if empty
+   */
+  bool front(timestamp_t now, data_view& frame, uint8_t& tag, uint32_t& expired) {
+    for (auto& q : queues_) {
+      while (q.size) {
+        auto& item = q.items[q.head];
+        if ((int32_t)(now - item.deadline) > 0) {
+          pool_.release(item.frame);
+          q.head = (q.head + 1) % Capacity;
+          --q.size;
+          ++expired;
+          continue;
+        }
+        pool_.get(item.frame, frame);
+        tag = item.tag;
+        front_ = &q;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * remove the frame returned by `front()`
+   */
+  void pop() {
+    auto& q = *front_;
+    pool_.release(q.items[q.head].frame);
+    q.head = (q.head + 1) % Capacity;
+    --q.size;
+  }
+
+  size_t size() const {
+    return pool_.size();
+  }
+
+ private:
+  struct item_t {
+    typename pool_t::handle frame;
+    timestamp_t deadline;
+    uint8_t tag;
+  };
+
+  struct queue_t {
+    item_t items[Capacity];
+    uint16_t head;
+    uint16_t size;
+  };
+
+  bool evict_lower(int priority) {
+    for (int p = PriorityNum - 1; p > priority; --p) {
+      auto& q = queues_[p];
+      if (!q.size) continue;
+      --q.size;
+      pool_.release(q.items[(q.head + q.size) % Capacity].frame);
+      return true;
+    }
+    return false;
+  }
+
+ private:
+  pool_t pool_;
+  queue_t queues_[PriorityNum]{};
+  queue_t* front_{};
+};
+
+/**
+ * Impl without tx done, frames are sent at once
+ */
+struct tx_queue_none {
+  bool front(timestamp_t, data_view&, uint8_t&, uint32_t&) {
+    return false;
+  }
+
+  void pop() {}
+
+  size_t size() const {
+    return 0;
+  }
+};
+
+}  // namespace detail
+}  // namespace mesh_core
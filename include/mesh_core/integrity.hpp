@@ -0,0 +1,60 @@
+#pragma once
+
+// config
+#include "config.hpp"
+#include "utils.hpp"
+
+// std
+#include <cstddef>
+#include <cstdint>
+
+namespace mesh_core {
+
+/**
+ * frame integrity policy, the check value is appended to each frame.
+ *
+ * policy requirements:
+ * 1. `Size`: check value size in frame, <= 4
+ * 2. `uint32_t calc(const void* data, size_t size)`
+ *
+ * NOTE: all nodes in one mesh should use the same policy
+ */
+namespace integrity {
+
+/**
+ * for transports already guarantee integrity, e.g. UDP, LoRa with hardware crc
+ */
+struct none {
+  static const uint8_t Size = 0;
+
+  static uint32_t calc(const void* data, size_t size) {
+    (void)(data);
+    (void)(size);
+    return 0;
+  }
+};
+
+/**
+ * CRC-16/CCITT-FALSE, default
+ */
+struct crc16 {
+  static const uint8_t Size = 2;
+
+  static uint32_t calc(const void* data, size_t size) {
+    return utils::crc16(data, size);
+  }
+};
+
+/**
+ * CRC-32C(Castagnoli), stronger check, hardware accelerated on x86(SSE4.2) and ARMv8
+ */
+struct crc32c {
+  static const uint8_t Size = 4;
+
+  static uint32_t calc(const void* data, size_t size) {
+    return utils::crc32c(data, size);
+  }
+};
+
+}  // namespace integrity
+}  // namespace mesh_core
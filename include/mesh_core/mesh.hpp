@@ -4,36 +4,86 @@
 #include "mesh_core/config.hpp"
 
 // other include
+#include "mesh_core/detail/airtime_budget.hpp"
 #include "mesh_core/detail/copyable.hpp"
+#include "mesh_core/detail/dup_filter.hpp"
+#include "mesh_core/detail/frame_pool.hpp"
+#include "mesh_core/detail/hop_ack_table.hpp"
+#include "mesh_core/detail/impl_traits.hpp"
 #include "mesh_core/detail/log.h"
-#include "mesh_core/detail/lru_record.hpp"
+#include "mesh_core/detail/mpr_selector.hpp"
 #include "mesh_core/detail/noncopyable.hpp"
+#include "mesh_core/detail/reassembly.hpp"
+#include "mesh_core/detail/rebroadcast_table.hpp"
+#include "mesh_core/detail/reliable.hpp"
+#include "mesh_core/detail/timer_wheel.hpp"
+#include "mesh_core/detail/tx_queue.hpp"
+#include "mesh_core/integrity.hpp"
+#include "mesh_core/mesh_config.hpp"
 #include "mesh_core/message.hpp"
 #include "mesh_core/route_table.hpp"
+#include "mesh_core/stats.hpp"
 #include "mesh_core/type.hpp"
 #include "mesh_core/utils.hpp"
 
 // std
+#include <algorithm>
 #include <cinttypes>
+#include <cstring>
 #include <functional>
+#include <initializer_list>
+#include <limits>
+#include <memory>
 #include <string>
+#include <type_traits>
 
 namespace mesh_core {
 
 /// interceptor
-#ifdef MESH_CORE_ENABLE_BROADCAST_INTERCEPTOR
-using broadcast_interceptor_t = std::function<bool(message&)>;
-#endif
-
-#ifdef MESH_CORE_ENABLE_DISPATCH_INTERCEPTOR
-using dispatch_interceptor_t = std::function<bool(message&)>;
-#endif
+using broadcast_interceptor_t = detail::inplace_function<bool(message&)>;
+using dispatch_interceptor_t = detail::inplace_function<bool(message&)>;
 
-template <typename Impl>
+/**
+ * @tparam Impl platform implementation
+ * @tparam Config features and constants, see mesh_config.hpp, or a frame integrity policy(integrity.hpp) with default config
+ */
+template <typename Impl, typename Config = default_config>
 class mesh : detail::noncopyable {
  public:
-  explicit mesh(Impl* impl) : impl_(impl) {}
+  using config = typename detail::config_of<Config>::type;
+  using integrity_type = typename config::integrity_type;
+  using frame_size = message::frame_size<integrity_type>;
+  static_assert(config::Ttl > 0 && config::Ttl <= MESH_CORE_TTL_DEFAULT, "ttl should <= MESH_CORE_TTL_DEFAULT");
+  static_assert(config::DelayMsMin <= config::DelayMsMax, "delay error");
+
+  // interfaces of Impl, 1 if it has no `InterfaceNum`
+  static const iface_t InterfaceNum = detail::interface_num<Impl>::value;
+  static_assert(InterfaceNum >= 1 && InterfaceNum <= 8, "interface num should in [1, 8]");
+  static_assert(!detail::has_interfaces<Impl>::value || !detail::has_tx_done<Impl>::value, "tx done is only for single interface Impl");
 
+  // data max size for send and broadcast
+  static const uint8_t DataSizeMax = frame_size::DataMax;
+  // data size of each fragment, and max size for send_large
+  static const uint8_t FragmentSizeMax = DataSizeMax - sizeof(fragment_msg);
+  static const uint32_t LargeDataSizeMax = (uint32_t)FragmentSizeMax * MESH_CORE_FRAGMENT_NUM_MAX;
+  // data max size for send_reliable
+  static const uint8_t ReliableSizeMax = DataSizeMax - sizeof(reliable_msg);
+  static_assert(!config::Mpr || sizeof(addr_t) == 1, "mpr only for 8bit address");
+
+ private:
+  // bit i for interface i
+  using iface_mask_t = uint8_t;
+  static const iface_mask_t AllIfaces = (iface_mask_t)((1u << InterfaceNum) - 1);
+
+ public:
+  explicit mesh(Impl* impl) : impl_(impl) {
+    airtime_.set_limit(0, config::DutyCyclePermille, config::DutyCycleWindowMs);
+  }
+
+  /**
+   * handles given to Impl(recv, tx done, run_delay) do nothing once mesh is destroyed, Impl may keep or call them.
+   * they watch a shared alive token, its control block is the only heap allocation here(`mesh_init` in bench)
+   */
   void init(addr_t addr, bool enable_dv_routing = true) {
     addr_ = addr;
     init_(enable_dv_routing);
@@ -43,21 +93,119 @@ class mesh : detail::noncopyable {
     return addr_;
   }
 
-  void send(addr_t dst, data_t data) {
-    if (data.size() > message::DataSizeMax) {
-      MESH_CORE_LOGE("data size > %d", message::DataSizeMax);
-      return;
+  /**
+   * @return false if dropped: data too large, or tx queue is full(backpressure), see `tx_pending()`
+   */
+  bool send(addr_t dst, data_view data) {
+    return send(dst, &data, 1);
+  }
+
+  /**
+   * gather data segments into one message, no need to concatenate them
+   */
+  bool send(addr_t dst, std::initializer_list<data_view> segs) {
+    return send(dst, segs.begin(), segs.size());
+  }
+
+  bool send(addr_t dst, const data_view* segs, size_t seg_num) {
+    if (data_size(segs, seg_num) > DataSizeMax) {
+      MESH_CORE_LOGE("data size > %d", DataSizeMax);
+      MESH_CORE_STATS(++stats.serialize_fails);
+      return false;
     }
+    return unicast(message_type::user_data, dst, segs, seg_num);
+  }
 
-    message m = create_message(message_type::user_data, dst);
-    auto info = route_table_.find_node(dst);
-    m.next_hop = info ? info->next_hop : addr_;
-    m.data = std::move(data);
-    broadcast(std::move(m));
+  /**
+   * send with end-to-end ack, lost messages are retransmitted by timeout estimated from rtt.
+   * `dst` receives it by `on_recv()` once, but may be out of order
+   * @param done true if acked, false if no ack after config::ReliableRetry retransmissions
+   * @return false if data too large, or the window to `dst` is full, see `reliable_pending()`
+   */
+  bool send_reliable(addr_t dst, data_view data, send_done_handle_t done = nullptr) {
+    static_assert(config::Reliable, "reliable is disabled by Config");
+    if (data.size() > ReliableSizeMax) {
+      MESH_CORE_LOGE("data size > %d", ReliableSizeMax);
+      MESH_CORE_STATS(++stats.serialize_fails);
+      return false;
+    }
+    int i = reliable_tx_.add(get_timestamp(), dst, data, (uint8_t)random(0, 0xFF));
+    if (i < 0) {
+      MESH_CORE_LOGD("send_reliable: window full, dst: 0x%02X", dst);
+      return false;
+    }
+    reliable_tx_.at(i).done = std::move(done);
+    send_reliable(i);
+    return true;
+  }
+
+  /**
+   * reliable messages waiting for ack
+   */
+  size_t reliable_pending() const {
+    static_assert(config::Reliable, "reliable is disabled by Config");
+    return reliable_tx_.size();
+  }
+
+  /**
+   * @return smoothed round trip time to `dst` by reliable messages, 0 if unknown
+   */
+  uint32_t get_rtt(addr_t dst) const {
+    static_assert(config::Reliable, "reliable is disabled by Config");
+    return reliable_tx_.srtt(dst);
+  }
+
+  /**
+   * send data larger than DataSizeMax as numbered fragments, one per config::FragmentIntervalMs.
+   * one payload at a time, lost fragments are not retransmitted, the receiver drops the incomplete payload
+   * @param data should be valid until `done`
+   * @param done true if all fragments are sent, false if stalled for config::ReassemblyTimeoutMs
+   * @return false if busy, data too large or no free timer
+   */
+  bool send_large(addr_t dst, data_view data, send_done_handle_t done = nullptr) {
+    static_assert(config::Fragment, "fragment is disabled by Config");
+    if (fragment_tx_.timer) {
+      MESH_CORE_LOGE("send_large: busy");
+      return false;
+    }
+    if (data.size() > LargeDataSizeMax) {
+      MESH_CORE_LOGE("data size > %" PRIu32, LargeDataSizeMax);
+      MESH_CORE_STATS(++stats.serialize_fails);
+      return false;
+    }
+    auto& tx = fragment_tx_;
+    tx.data = data;
+    tx.dst = dst;
+    tx.id = fragment_id_++;
+    tx.index = 0;
+    tx.count = data.empty() ? 1 : (uint16_t)((data.size() + FragmentSizeMax - 1) / FragmentSizeMax);
+    tx.ts = get_timestamp();
+    tx.timer = add_timer(
+        [this] {
+          send_fragment();
+        },
+        0, config::FragmentIntervalMs);
+    if (tx.timer == 0) return false;
+    tx.done = std::move(done);
+    return true;
+  }
+
+  bool sending_large() const {
+    static_assert(config::Fragment, "fragment is disabled by Config");
+    return fragment_tx_.timer != 0;
+  }
+
+  /**
+   * deliver fragments as they arrive, instead of the whole payload by `on_recv()`.
+   * so the receiver can write them at `offset`, a large payload(e.g. OTA image) never need to be held in RAM
+   */
+  void on_recv_fragment(on_recv_fragment_handle_t handle) {
+    static_assert(config::Fragment, "fragment is disabled by Config");
+    on_recv_fragment_handle_ = std::move(handle);
   }
 
-#ifdef MESH_CORE_ENABLE_ROUTE_DEBUG
   void send_route_debug(addr_t dst, bool is_send = true) {
+    static_assert(config::RouteDebug, "route debug is disabled by Config");
     auto type = is_send ? message_type::route_debug_send : message_type::route_debug_back;
     message m = create_message(type, dst);
     auto info = route_table_.find_node(dst);
@@ -65,133 +213,451 @@ class mesh : detail::noncopyable {
     m.data = std::to_string(addr_);
     broadcast(std::move(m));
   }
-#endif
 
-  void broadcast(data_t data) {
-    if (data.size() > message::DataSizeMax) {
-      MESH_CORE_LOGE("data size > %d", message::DataSizeMax);
-      return;
+  /**
+   * @return false if dropped, same as `send()`
+   */
+  bool broadcast(data_view data) {
+    return broadcast(&data, 1);
+  }
+
+  /**
+   * gather data segments into one message, no need to concatenate them
+   */
+  bool broadcast(std::initializer_list<data_view> segs) {
+    return broadcast(segs.begin(), segs.size());
+  }
+
+  bool broadcast(const data_view* segs, size_t seg_num) {
+    if (data_size(segs, seg_num) > DataSizeMax) {
+      MESH_CORE_LOGE("data size > %d", DataSizeMax);
+      MESH_CORE_STATS(++stats.serialize_fails);
+      return false;
     }
     message m = create_message(message_type::broadcast, {});
-    m.data = std::move(data);
-    broadcast(std::move(m));
+    return broadcast(m, segs, seg_num);
+  }
+
+  /**
+   * limit transmit airtime over a sliding window, need `Impl::airtime_us` or MESH_CORE_AIRTIME_BITRATE.
+   * low priority frames stop at config::AirtimeReservePercent, they wait in tx queue, or are dropped if no tx queue
+   * @param permille 0 for unlimited
+   */
+  void set_duty_cycle(uint16_t permille, uint32_t window_ms = config::DutyCycleWindowMs) {
+    airtime_.set_limit(get_timestamp(), permille, window_ms);
+  }
+
+  /**
+   * @return airtime can be used in the current window, UINT32_MAX if unlimited
+   */
+  uint32_t airtime_budget_us() {
+    return airtime_.remaining(get_timestamp());
+  }
+
+  /**
+   * hop by hop reliability for unicast, enabled by default.
+   * a frame sent to a next hop is retransmitted until the next hop is heard forwarding it(implicit ack), no extra ack frame.
+   * if not heard after config::HopAckRetry retransmissions, routes via the next hop are degraded for config::RouteDegradeMs
+   */
+  void set_hop_ack(bool enable) {
+    static_assert(config::HopAck, "hop ack is disabled by Config");
+    hop_ack_ = enable;
+  }
+
+  /**
+   * frames waiting for tx done, always 0 if Impl has no `set_tx_done_handle`
+   */
+  size_t tx_pending() const {
+    return tx_queue_.size();
   }
 
   void on_recv(on_recv_handle_t handle) {
     on_recv_handle_ = std::move(handle);
   }
 
-#ifdef MESH_CORE_ENABLE_ROUTE_DEBUG
   void on_recv_debug(on_recv_debug_handle_t handle) {
+    static_assert(config::RouteDebug, "route debug is disabled by Config");
     on_recv_debug_handle_ = std::move(handle);
   }
-#endif
 
-#ifdef MESH_CORE_ENABLE_TIME_SYNC
   void on_sync_time(time_sync_handle_t handle) {
+    static_assert(config::TimeSync, "time sync is disabled by Config");
     time_sync_handle_ = std::move(handle);
   }
-#endif
 
   timestamp_t get_timestamp() {
     return impl_->get_timestamp_ms();
   }
 
-#ifdef MESH_CORE_ENABLE_TIME_SYNC
+  /**
+   * run expired timers.
+   * if Impl has `run_delay`, it is called automatically, otherwise call it from your timer, see `next_timeout()`
+   */
+  void poll() {
+    timer_.poll(get_timestamp());
+    arm_timer();
+  }
+
+  /**
+   * @return ms to the next `poll()`, UINT32_MAX if no timer
+   */
+  uint32_t next_timeout() {
+    return timer_.next_timeout(get_timestamp());
+  }
+
   uint32_t sync_time() {
+    static_assert(config::TimeSync, "time sync is disabled by Config");
     message m = create_message(message_type::sync_time, {});
     broadcast(std::move(m));
     return m.ts;
   }
-#endif
 
-  void add_static_route(addr_t dst, addr_t next_hop) {
+  /**
+   * @return nullptr if no route
+   */
+  const route_info* get_route(addr_t dst) const {
+    return route_table_.find_node(dst);
+  }
+
+  /**
+   * @param f void(const route_info&), for all routes include self
+   */
+  template <typename F>
+  void for_each_route(F&& f) const {
+    route_table_.for_each(std::forward<F>(f));
+  }
+
+  const mesh_stats& stats() const {
+    static_assert(config::Stats, "stats is disabled by Config");
+    return stats_;
+  }
+
+  void reset_stats() {
+    static_assert(config::Stats, "stats is disabled by Config");
+    stats_ = {};
+  }
+
+  /**
+   * switch at runtime, all nodes should use the same mode, mpr relays like flooding if Mpr of Config is false
+   */
+  void set_relay_mode(relay_mode mode) {
+    relay_mode_ = mode;
+  }
+
+  void add_static_route(addr_t dst, addr_t next_hop, iface_t iface = 0) {
     route_info info;
     info.dst = dst;
     info.next_hop = next_hop;
     info.metric = 1;
     info.type = route_type::STATIC;
+    info.iface = iface;
     route_table_.add(info);
+    trigger_route_update();
+  }
+
+  /**
+   * cost and flood policy of an interface, one node can bridge several transports(e.g. LoRa and RS-485) under one address.
+   * duplicate suppression and the route table are shared by all interfaces,
+   * unicast is sent on the interface of its route, floods are sent once on each interface allowed by `conf`
+   * @return false if no such interface or cost is 0
+   */
+  bool set_interface(iface_t iface, interface_config conf) {
+    if (iface >= InterfaceNum || conf.cost == 0) return false;
+    interfaces_[iface] = conf;
+    return true;
+  }
+
+  const interface_config& get_interface(iface_t iface) const {
+    return interfaces_[iface < InterfaceNum ? iface : 0];
   }
 
-#ifdef MESH_CORE_ENABLE_BROADCAST_INTERCEPTOR
   /**
    * @param interceptor return true for continue
    */
   void set_broadcast_interceptor(broadcast_interceptor_t interceptor) {
+    static_assert(config::BroadcastInterceptor, "broadcast interceptor is disabled by Config");
     broadcast_interceptor_ = std::move(interceptor);
   }
-#endif
 
-#ifdef MESH_CORE_ENABLE_DISPATCH_INTERCEPTOR
   /**
    * @param interceptor return true for continue
    */
   void set_dispatch_interceptor(dispatch_interceptor_t interceptor) {
+    static_assert(config::DispatchInterceptor, "dispatch interceptor is disabled by Config");
     dispatch_interceptor_ = std::move(interceptor);
   }
-#endif
 
   void dump_debug() {
-    MESH_CORE_LOGD("route table: 0x%02X: %" PRIu32, addr_, (uint32_t)route_table_.get_table().size());
-    for (const auto& item : route_table_.get_table()) {
+    MESH_CORE_LOGD("route table: 0x%02X: %" PRIu32, addr_, (uint32_t)route_table_.size());
+    for (const auto& item : route_table_) {
       MESH_CORE_LOGD("dst: 0x%02X, next_hop: 0x%02X, metric: %d, lqs: %d, expired: 0x%08" PRIX32, item.dst, item.next_hop, item.metric, item.lqs,
                      item.expired);
     }
   }
 
   void sync_route(bool request = false) {
-#ifdef MESH_CORE_DISABLE_ROUTE
-    // only report self
+    sync_route(request, detail::feature<config::Route>{});
+  }
+
+ private:
+  /**
+   * no route, only report self
+   */
+  void sync_route(bool request, std::false_type) {
     auto type = request ? message_type::route_info_and_request : message_type::route_info;
     message m = create_message(type, {});
     route_msg rm;
     rm.dst = addr_;
     rm.next_hop = addr_;
     rm.metric = 0;
-    m.data.append(reinterpret_cast<const char*>(&rm), sizeof(rm));
-    broadcast(std::move(m));
-#else
-    const auto& table = route_table_.get_table();
-    const int max_per_msg = (int)(message::DataSizeMax / sizeof(route_msg));
-    auto it = table.begin();
-    while (it != table.end()) {
+    data_view seg(&rm, sizeof(rm));
+    broadcast(m, &seg, 1);
+  }
+
+  void sync_route(bool request, std::true_type) {
+    constexpr int max_per_msg = (int)(DataSizeMax / sizeof(route_msg));
+    route_msg rms[max_per_msg];
+    auto it = route_table_.begin();
+    while (it != route_table_.end()) {
       message m = create_message(message_type::route_info, {});
       int count = 0;
-      route_msg rm;
-      while (it != table.end() && count < max_per_msg) {
+      while (it != route_table_.end() && count < max_per_msg) {
         const auto& item = *it;
+        route_msg& rm = rms[count];
         rm.dst = item.dst;
-        rm.next_hop = addr_;
-        rm.metric = item.metric;
-        m.data.append(reinterpret_cast<const char*>(&rm), sizeof(rm));
+        rm.next_hop = item.next_hop;
+        rm.metric = advertise_metric(item);
+        route_table_.clear_dirty(item.dst);
         ++it;
         ++count;
       }
 
-      if (it == table.cend() && request) {
+      if (it == route_table_.end() && request) {
         m.type = message_type::route_info_and_request;
       }
-      broadcast(std::move(m));
+      data_view seg(rms, count * sizeof(route_msg));
+      broadcast(m, &seg, 1);
     }
-#endif
   }
 
- private:
-  void init_(bool enable_dv_routing) {
-    impl_->set_recv_handle([this](const std::string& payload, lqs_t lqs) {
-      bool ok = false;
-      auto msg = message::deserialize(payload, ok);
-      if (ok) {
-        this->dispatch(std::move(msg), lqs);
-      } else {
-        MESH_CORE_LOGV("deserialize error");
+  bool unicast(message_type type, addr_t dst, const data_view* segs, size_t seg_num) {
+    message m = create_message(type, dst);
+    auto info = route_table_.find_node(dst);
+    m.next_hop = info ? info->next_hop : addr_;
+    return broadcast(m, segs, seg_num);
+  }
+
+  /**
+   * send or retransmit, and wait for ack with exponential backoff
+   */
+  void send_reliable(int i) {
+    auto& e = reliable_tx_.at(i);
+    if (e.tries > config::ReliableRetry) {
+      MESH_CORE_LOGD("send_reliable: no ack, seq: %u", e.seq);
+      finish_send_reliable(i, false);
+      return;
+    }
+    addr_t dst{};
+    reliable_msg rm;
+    data_view data;
+    if (!reliable_tx_.frame(i, dst, rm, data)) return;
+    data_view segs[2] = {data_view(&rm, sizeof(rm)), data};
+    uint8_t gen = e.gen;
+    unicast(message_type::reliable_data, dst, segs, 2);
+    MESH_CORE_STATS(stats.retransmits += e.tries ? 1 : 0);
+    // Impl may deliver the ack inside broadcast, the slot is released or even reused by then
+    if (!e.used || e.gen != gen) return;
+    ++e.tries;
+    e.timer = add_timer(
+        [this, i] {
+          reliable_tx_.at(i).timer = 0;
+          send_reliable(i);
+        },
+        reliable_tx_.rto(i, config::ReliableRtoInitMs, config::ReliableRtoMinMs, config::ReliableRtoMaxMs));
+    if (e.timer == 0) finish_send_reliable(i, false);
+  }
+
+  void finish_send_reliable(int i, bool ok) {
+    auto& e = reliable_tx_.at(i);
+    if (e.timer) timer_.cancel(e.timer);
+    auto done = std::move(e.done);
+    reliable_tx_.release(i);
+    if (done) done(ok);
+  }
+
+  /**
+   * at most one fragment waits in tx queue, so other traffic is not blocked
+   */
+  void send_fragment() {
+    auto& tx = fragment_tx_;
+    if (tx_pending() == 0) {
+      fragment_msg frag;
+      frag.id = tx.id;
+      frag.index = tx.index;
+      frag.count = tx.count;
+      size_t offset = (size_t)tx.index * FragmentSizeMax;
+      size_t size = std::min(tx.data.size() - offset, (size_t)FragmentSizeMax);
+      data_view segs[2] = {data_view(&frag, sizeof(frag)), data_view(tx.data.data() + offset, size)};
+      if (unicast(message_type::fragment, tx.dst, segs, 2)) {
+        tx.ts = get_timestamp();
+        if (++tx.index == tx.count) finish_send_large(true);
+        return;
       }
-    });
+    }
+    if (get_timestamp() - tx.ts > config::ReassemblyTimeoutMs) {
+      MESH_CORE_LOGD("send_large: stalled, dst: 0x%02X, fragment: %u/%u", tx.dst, tx.index, tx.count);
+      finish_send_large(false);
+    }
+  }
+
+  void finish_send_large(bool ok) {
+    auto& tx = fragment_tx_;
+    timer_.cancel(tx.timer);
+    tx.timer = 0;
+    tx.data = {};
+    auto done = std::move(tx.done);
+    if (done) done(ok);
+  }
+
+  /**
+   * advertise changed routes only, removed routes are advertised as withdrawal(metric = TTL_DEFAULT)
+   */
+  void sync_route_delta() {
+    constexpr int max_per_msg = (int)(DataSizeMax / sizeof(route_msg));
+    route_msg rms[max_per_msg];
+    size_t i = route_table_.next_dirty(0);
+    while (i < route_table_t::Capacity) {
+      message m = create_message(message_type::route_info, {});
+      int count = 0;
+      while (i < route_table_t::Capacity && count < max_per_msg) {
+        const auto& info = route_table_.slot(i);
+        bool used = route_table_.slot_used(i);
+        route_msg& rm = rms[count];
+        rm.dst = info.dst;
+        rm.next_hop = used ? info.next_hop : addr_;
+        rm.metric = used ? advertise_metric(info) : TTL_DEFAULT;
+        route_table_.clear_slot_dirty(i);
+        i = route_table_.next_dirty(i + 1);
+        ++count;
+      }
+      data_view seg(rms, count * sizeof(route_msg));
+      broadcast(m, &seg, 1);
+    }
+  }
+
+  uint8_t advertise_metric(const route_info& info) const {
+    return advertise_metric(info, detail::feature<config::Mpr>{});
+  }
+
+  uint8_t advertise_metric(const route_info& info, std::false_type) const {
+    return info.metric;
+  }
+
+  uint8_t advertise_metric(const route_info& info, std::true_type) const {
+    if (info.metric > 0 && info.next_hop == info.dst && mpr_.is_mpr(info.dst)) {
+      return info.metric | route_msg::FlagMpr;
+    }
+    return info.metric;
+  }
+
+  void update_mpr() {
+    update_mpr(detail::feature<config::Mpr>{});
+  }
 
+  void update_mpr(std::false_type) {}
+
+  /**
+   * reselect MPR if neighbors changed, changed neighbors will be advertised
+   */
+  void update_mpr(std::true_type) {
+    typename mpr_t::addr_set neighbors;
+    for (const auto& item : route_table_) {
+      // neighbor, metric is the interface cost
+      if (item.metric > 0 && item.next_hop == item.dst) {
+        neighbors.set(item.dst);
+      }
+    }
+    typename mpr_t::addr_set changed;
+    if (!mpr_.update(neighbors, addr_, changed)) return;
+    for (size_t n = changed.find_next(0); n < changed.Size; n = changed.find_next(n + 1)) {
+      route_table_.mark_dirty((addr_t)n);
+    }
+  }
+
+  /**
+   * two hop neighbors and selectors from route_info of neighbor `src`
+   */
+  void mpr_learn(addr_t src, const route_msg& rm, std::true_type) {
+    uint8_t metric = rm.metric & route_msg::MetricMask;
+    mpr_.set_two_hop(src, rm.dst, metric > 0 && rm.next_hop == rm.dst);
+    if (rm.dst == addr_) mpr_.set_selector(src, rm.metric & route_msg::FlagMpr);
+  }
+
+  void mpr_learn(addr_t, const route_msg&, std::false_type) {}
+
+  /**
+   * @return false if in MPR mode and the last hop did not select us
+   */
+  bool mpr_relay(const message_view& msg, std::true_type) const {
+    return relay_mode_ != relay_mode::mpr || mpr_.is_selector(msg.next_hop);
+  }
+
+  bool mpr_relay(const message_view&, std::false_type) const {
+    return true;
+  }
+
+  void trigger_route_update() {
+    trigger_route_update(detail::feature<config::Route>{});
+  }
+
+  /**
+   * no route to advertise, changes are not tracked, so slots of removed routes can be reused
+   */
+  void trigger_route_update(std::false_type) {
+    route_table_.clear_dirty();
+  }
+
+  /**
+   * send route delta soon, but at most once per config::RouteTriggerIntervalMs,
+   * changes during the interval are merged into one update
+   */
+  void trigger_route_update(std::true_type) {
+    if (!dv_routing_ || route_update_pending_ || !route_table_.has_dirty()) return;
+    route_update_pending_ = true;
+    uint32_t elapsed = get_timestamp() - route_update_ts_;
+    uint32_t delay = random(config::DelayMsMin, config::DelayMsMax);
+    if (elapsed < config::RouteTriggerIntervalMs) {
+      delay += config::RouteTriggerIntervalMs - elapsed;
+    }
+    auto id = add_timer(
+        [this] {
+          route_update_pending_ = false;
+          route_update_ts_ = get_timestamp();
+          sync_route_delta();
+        },
+        delay);
+    if (id == 0) {
+      route_update_pending_ = false;
+    }
+  }
+
+  void init_(bool enable_dv_routing) {
+    std::weak_ptr<bool> alive = alive_token();
+    set_tx_done_handle(
+        [this, alive] {
+          if (alive.expired()) return;
+          tx_busy_ = false;
+          tx_drain();
+        },
+        detail::has_tx_done<Impl>{});
+    set_recv_handle(detail::has_interfaces<Impl>{});
+
+    dv_routing_ = enable_dv_routing;
     if (enable_dv_routing) {
+      route_update_ts_ = get_timestamp() - config::RouteTriggerIntervalMs;
       route_info info;
       info.dst = addr_;
+      info.next_hop = addr_;
       info.metric = 0;
       route_table_.add(info);
 
@@ -200,23 +666,104 @@ class mesh : detail::noncopyable {
           [this] {
             sync_route();
           },
-          MESH_CORE_ROUTE_SYNC_INTERVAL_MS);
+          config::RouteSyncIntervalMs);
 
       run_interval(
           [this] {
-            route_table_.check_expired(get_timestamp());
+            auto removed = route_table_.check_expired(get_timestamp(), config::RouteExpiredMs, config::RouteHoldDownMs);
+            MESH_CORE_STATS(stats.route_expiries += (uint32_t)removed);
+            if (removed) {
+              update_mpr();
+              trigger_route_update();
+            }
           },
-          MESH_CORE_ROUTE_CHECK_EXPIRED_INTERVAL_MS);
+          config::RouteCheckExpiredIntervalMs);
     }
   }
 
-  void run_interval(std::function<void()> handle, uint32_t ms) {
-    auto task = new std::function<void()>();  // no delete/cancel for now
-    *task = [this, handle = std::move(handle), ms, task]() {
-      handle();
-      impl_->run_delay(*task, ms);
-    };
-    impl_->run_delay(*task, ms);
+  void set_recv_handle(std::false_type) {
+    std::weak_ptr<bool> alive = alive_token();
+    impl_->set_recv_handle([this, alive](data_view payload, lqs_t lqs) {
+      if (alive.expired()) return;
+      on_frame(payload, lqs, 0);
+    });
+  }
+
+  void set_recv_handle(std::true_type) {
+    std::weak_ptr<bool> alive = alive_token();
+    for (iface_t i = 0; i < InterfaceNum; ++i) {
+      impl_->set_recv_handle(i, [this, alive, i](data_view payload, lqs_t lqs) {
+        if (alive.expired()) return;
+        on_frame(payload, lqs, i);
+      });
+    }
+  }
+
+  /**
+   * expires with mesh, captured by handles given to Impl, allocated once by the first of them in init
+   */
+  const std::shared_ptr<bool>& alive_token() {
+    if (!alive_) alive_ = std::make_shared<bool>(true);
+    return alive_;
+  }
+
+  void on_frame(data_view payload, lqs_t lqs, iface_t iface) {
+    bool ok = false;
+    drop_reason reason = drop_reason::num;
+    auto msg = message_view::parse<integrity_type>(payload, ok, &reason);
+    if (ok) {
+      MESH_CORE_STATS(count_traffic(stats.rx, msg.type, payload.size()));
+      rx_iface_ = iface;
+      this->dispatch(msg, lqs);
+    } else {
+      MESH_CORE_LOGV("deserialize error");
+      MESH_CORE_STATS(count_drop(stats, reason));
+    }
+  }
+
+  void run_interval(detail::timer_wheel::callback_t handle, uint32_t ms) {
+    add_timer(std::move(handle), ms, ms);
+  }
+
+  /**
+   * @return 0 if no free timer
+   */
+  detail::timer_wheel::id_t add_timer(detail::timer_wheel::callback_t handle, uint32_t ms, uint32_t period_ms = 0) {
+    auto id = timer_.add(get_timestamp(), ms, std::move(handle), period_ms);
+    if (id == 0) {
+      MESH_CORE_LOGE("no free timer");
+    }
+    arm_timer();
+    return id;
+  }
+
+  void arm_timer() {
+    arm_timer(detail::has_run_delay<Impl>{});
+  }
+
+  /**
+   * no run_delay, user should call poll()
+   */
+  void arm_timer(std::false_type) {}
+
+  /**
+   * only one pending run_delay for the nearest deadline, Impl::run_delay may outlive mesh
+   */
+  void arm_timer(std::true_type) {
+    uint32_t timeout = timer_.next_timeout(get_timestamp());
+    if (timeout == UINT32_MAX) return;
+    timestamp_t deadline = get_timestamp() + timeout;
+    if (timer_armed_ && (int32_t)(deadline - timer_deadline_) >= 0) return;
+    timer_armed_ = true;
+    timer_deadline_ = deadline;
+    std::weak_ptr<bool> alive = alive_token();
+    impl_->run_delay(
+        [this, alive, deadline] {
+          if (alive.expired()) return;
+          if (deadline == timer_deadline_) timer_armed_ = false;
+          poll();
+        },
+        timeout);
   }
 
   message create_message(message_type type, addr_t dst) {
@@ -225,52 +772,380 @@ class mesh : detail::noncopyable {
     m.src = addr_;
     m.dst = dst;
     m.seq = seq_++;
-    m.ttl = TTL_DEFAULT;
+    m.ttl = config::Ttl;
     m.ts = impl_->get_timestamp_ms();
+    m.next_hop = addr_;
     return m;
   }
 
-  void broadcast(message msg) {
-#ifdef MESH_CORE_ENABLE_BROADCAST_INTERCEPTOR
+  bool broadcast(message msg, iface_mask_t egress = 0) {
     /// broadcast interceptor
+    if (!intercept_broadcast(msg, detail::feature<config::BroadcastInterceptor>{})) {
+      MESH_CORE_LOGD("broadcast: interceptor abort");
+      return false;
+    }
+
+    data_view seg(msg.data);
+    return transmit(msg, &seg, 1, egress);
+  }
+
+  /**
+   * @param egress interfaces to send on, 0 for `egress_of(header)`
+   */
+  bool broadcast(message_header& header, const data_view* segs, size_t seg_num, iface_mask_t egress = 0) {
+    return broadcast(header, segs, seg_num, egress, detail::feature<config::BroadcastInterceptor>{});
+  }
+
+  bool broadcast(message_header& header, const data_view* segs, size_t seg_num, iface_mask_t egress, std::false_type) {
+    return transmit(header, segs, seg_num, egress);
+  }
+
+  bool broadcast(message_header& header, const data_view* segs, size_t seg_num, iface_mask_t egress, std::true_type) {
+    /// interceptor need a complete message
     if (broadcast_interceptor_) {
-      bool should_continue = broadcast_interceptor_(msg);
-      if (!should_continue) {
-        MESH_CORE_LOGD("broadcast: interceptor abort");
-        return;
+      message msg;
+      static_cast<message_header&>(msg) = header;
+      for (size_t i = 0; i < seg_num; ++i) {
+        msg.data.append(segs[i].data(), segs[i].size());
       }
+      return broadcast(std::move(msg), egress);
+    }
+    return transmit(header, segs, seg_num, egress);
+  }
+
+  /**
+   * @return true for continue
+   */
+  bool intercept_broadcast(message& msg, std::true_type) {
+    return !broadcast_interceptor_ || broadcast_interceptor_(msg);
+  }
+
+  bool intercept_broadcast(message&, std::false_type) {
+    return true;
+  }
+
+  /**
+   * serialize into stack buffer once for all interfaces, no heap allocation
+   */
+  bool transmit(message_header& header, const data_view* segs, size_t seg_num, iface_mask_t egress) {
+    uint8_t buffer[frame_size::Max];
+    size_t size = header.template serialize_into<integrity_type>(buffer, sizeof(buffer), segs, seg_num);
+    if (size == 0) {
+      MESH_CORE_LOGE("data size > %d", DataSizeMax);
+      MESH_CORE_STATS(++stats.serialize_fails);
+      return false;
+    }
+    data_view frame(buffer, size);
+    if (!egress) egress = egress_of(header);
+    if (!transmit(header.type, frame, egress, detail::has_tx_done<Impl>{})) return false;
+    hop_ack_add(header, frame, detail::feature<config::HopAck>{});
+    return true;
+  }
+
+  void hop_ack_add(const message_header&, data_view, std::false_type) {}
+
+  /**
+   * wait for the next hop forwarding, the last hop is not tracked since the destination never forwards
+   */
+  void hop_ack_add(const message_header& header, data_view frame, std::true_type) {
+    if (!hop_ack_ || tx_priority_of(header.type) != tx_priority::unicast) return;
+    if (header.next_hop == addr_ || header.next_hop == header.dst || header.ttl <= 1) return;
+    auto uuid = header.cal_uuid();
+    if (hop_acks_.find(uuid) >= 0) return;
+    int i = hop_acks_.add(uuid, header.ttl, header.next_hop, (uint8_t)header.type, frame);
+    if (i < 0) {
+      MESH_CORE_LOGD("hop ack: full, uuid: 0x%08" PRIX64, (uint64_t)uuid);
+      return;
+    }
+    hop_ack_wait(i);
+  }
+
+  void hop_ack_wait(int i) {
+    auto& e = hop_acks_.at(i);
+    e.timer = add_timer(
+        [this, i] {
+          hop_acks_.at(i).timer = 0;
+          hop_ack_timeout(i);
+        },
+        config::HopAckTimeoutMs);
+    if (e.timer == 0) hop_acks_.release(i);
+  }
+
+  void hop_ack_timeout(int i) {
+    auto& e = hop_acks_.at(i);
+    if (e.tries >= config::HopAckRetry) {
+      MESH_CORE_LOGD("hop ack: next hop 0x%02X not heard, degrade", e.next_hop);
+      route_table_.degrade(e.next_hop, get_timestamp());
+      MESH_CORE_STATS(++stats.link_degrades);
+      hop_acks_.release(i);
+      return;
+    }
+    data_view frame;
+    hop_acks_.frame(i, frame);
+    ++e.tries;
+    MESH_CORE_STATS(++stats.hop_retransmits);
+    transmit((message_type)e.type, frame, egress_to(e.next_hop, e.next_hop), detail::has_tx_done<Impl>{});
+    hop_ack_wait(i);
+  }
+
+  void hop_ack_on_copy(const message_view&, std::false_type) {}
+
+  /**
+   * the next hop forwarded, any copy with a smaller ttl
+   */
+  void hop_ack_on_copy(const message_view& msg, std::true_type) {
+    int i = hop_acks_.on_copy(msg.cal_uuid(), msg.ttl);
+    if (i < 0) return;
+    auto& e = hop_acks_.at(i);
+    if (e.timer) timer_.cancel(e.timer);
+    route_table_.restore(e.next_hop);
+    hop_acks_.release(i);
+  }
+
+  void hop_ack_echo(const message_view&, std::false_type) {}
+
+  /**
+   * the last hop retransmits since it has not heard us forwarding, ack it with the same uuid and a smaller ttl.
+   * a hop_ack frame never reaches the dup filter, so the next hop still takes our own retry as new
+   */
+  void hop_ack_echo(const message_view& msg, std::true_type) {
+    if (!hop_ack_ || msg.next_hop != addr_ || msg.dst == addr_ || tx_priority_of(msg.type) != tx_priority::unicast) return;
+    if (msg.ttl <= 1 || !route_table_.find_node(msg.dst)) return;
+    message_header header = msg;
+    header.type = message_type::hop_ack;
+    header.ttl = msg.ttl - 1;
+    header.next_hop = addr_;
+    MESH_CORE_LOGD("hop ack: echo, src: 0x%02X, seq: %u", msg.src, msg.seq);
+    broadcast(header, nullptr, 0);
+  }
+
+  /**
+   * interfaces for a frame: floods by `interface_config`, routing to all, unicast by the route
+   */
+  iface_mask_t egress_of(const message_header& header) const {
+    if (InterfaceNum == 1) return 1;
+    switch (tx_priority_of(header.type)) {
+      case tx_priority::routing:
+        return AllIfaces;
+      case tx_priority::time_sync:
+      case tx_priority::flood:
+        return flood_ifaces(InterfaceNum);
+      default:
+        return egress_to(header.dst, header.next_hop);
     }
+  }
+
+  /**
+   * the interface of the route to dst via next_hop, or of the route to next_hop, all if unknown
+   */
+  iface_mask_t egress_to(addr_t dst, addr_t next_hop) const {
+    if (InterfaceNum == 1) return 1;
+    if (next_hop != addr_) {
+      auto info = route_table_.find_node(dst);
+      if (!info || info->next_hop != next_hop) info = route_table_.find_node(next_hop);
+      if (info && info->iface < InterfaceNum) return (iface_mask_t)(1u << info->iface);
+    }
+    return AllIfaces;
+  }
+
+  /**
+   * @param rx interface the flood is received on, InterfaceNum for own floods
+   */
+  iface_mask_t flood_ifaces(iface_t rx) const {
+    iface_mask_t mask = 0;
+    for (iface_t i = 0; i < InterfaceNum; ++i) {
+      const auto& conf = interfaces_[i];
+      if (conf.flood && (i != rx || conf.reflood)) mask |= (iface_mask_t)(1u << i);
+    }
+    return mask;
+  }
+
+  /**
+   * no tx done, send at once
+   */
+  bool transmit(message_type type, data_view frame, iface_mask_t egress, std::false_type) {
+    uint32_t cost = airtime_us(frame.size());
+    if (!airtime_.allow(get_timestamp(), cost, airtime_reserve_us(type))) {
+      MESH_CORE_LOGD("drop: no airtime, type: %d", (int)type);
+      MESH_CORE_STATS(count_drop(stats, drop_reason::airtime));
+      return false;
+    }
+    send_frame(type, frame, cost, egress);
+    return true;
+  }
+
+  /**
+   * airtime is shared by all interfaces
+   */
+  void send_frame(message_type type, data_view frame, uint32_t airtime, iface_mask_t egress) {
+    MESH_CORE_UNUSED(type);
+    airtime_.consume(get_timestamp(), airtime);
+    emit(frame, egress, detail::has_interfaces<Impl>{});
+    MESH_CORE_STATS(count_traffic(stats.tx, type, frame.size()));
+    MESH_CORE_STATS(stats.tx_airtime_us += airtime);
+  }
+
+  void emit(data_view frame, iface_mask_t, std::false_type) {
+    impl_->broadcast(frame);
+  }
+
+  void emit(data_view frame, iface_mask_t egress, std::true_type) {
+    for (iface_t i = 0; i < InterfaceNum; ++i) {
+      if (egress >> i & 1) impl_->broadcast(i, frame);
+    }
+  }
+
+  uint32_t airtime_us(size_t size) {
+    return airtime_us(size, detail::has_airtime<Impl>{});
+  }
+
+  uint32_t airtime_us(size_t size, std::true_type) {
+    return impl_->airtime_us(size);
+  }
+
+  uint32_t airtime_us(size_t size, std::false_type) {
+#if MESH_CORE_AIRTIME_BITRATE
+    return (uint32_t)((uint64_t)size * 8 * 1000000 / MESH_CORE_AIRTIME_BITRATE);
+#else
+    MESH_CORE_UNUSED(size);
+    return 0;
 #endif
+  }
 
-    /// broadcast message
-    bool ok;
-    auto payload = msg.serialize(ok);
-    if (ok) {
-      impl_->broadcast(std::move(payload));
-    } else {
-      MESH_CORE_LOGE("data size > %d", message::DataSizeMax);
+  /**
+   * budget low priority frames should leave
+   */
+  uint32_t airtime_reserve_us(message_type type) const {
+    if (tx_priority_of(type) <= tx_priority::time_sync) return 0;
+    return (uint32_t)((uint64_t)airtime_.limit_us() * config::AirtimeReservePercent / 100);
+  }
+
+  /**
+   * single interface only
+   */
+  bool transmit(message_type type, data_view frame, iface_mask_t, std::true_type) {
+    auto ret = tx_queue_.push(tx_priority_of(type), get_timestamp() + config::TxDeadlineMs, frame, (uint8_t)type);
+    if (ret == tx_queue_t::result::full) {
+      MESH_CORE_LOGD("drop: tx queue full, type: %d", (int)type);
+      MESH_CORE_STATS(count_drop(stats, drop_reason::tx_queue_full));
+      return false;
+    }
+    if (ret == tx_queue_t::result::evicted) {
+      MESH_CORE_LOGD("tx queue full, lower priority frame dropped");
+      MESH_CORE_STATS(count_drop(stats, drop_reason::tx_queue_full));
     }
+    tx_drain();
+    return true;
   }
 
-  void dispatch(message msg, lqs_t lqs) {
+  static tx_priority tx_priority_of(message_type type) {
+    switch (type) {
+      case message_type::route_info:
+      case message_type::route_info_and_request:
+        return tx_priority::routing;
+      case message_type::sync_time:
+        return tx_priority::time_sync;
+      case message_type::broadcast:
+        return tx_priority::flood;
+      default:
+        return tx_priority::unicast;
+    }
+  }
+
+  /**
+   * send one frame and wait for tx done, Impl may call tx done in broadcast
+   */
+  void tx_drain() {
+    if (tx_draining_) return;
+    tx_draining_ = true;
+    while (!tx_busy_) {
+      data_view frame;
+      uint8_t type;
+      uint32_t expired = 0;
+      bool ok = tx_queue_.front(get_timestamp(), frame, type, expired);
+      MESH_CORE_STATS(stats.drops[(int)drop_reason::tx_expired] += expired);
+      if (!ok) break;
+
+      uint32_t cost = airtime_us(frame.size());
+      uint32_t reserve = airtime_reserve_us((message_type)type);
+      if (!airtime_.allow(get_timestamp(), cost, reserve)) {
+        uint32_t wait = airtime_.wait_ms(get_timestamp(), cost, reserve);
+        if (wait == UINT32_MAX) {
+          MESH_CORE_LOGD("drop: frame exceed airtime limit");
+          MESH_CORE_STATS(count_drop(stats, drop_reason::airtime));
+          tx_queue_.pop();
+          continue;
+        }
+        // wait in queue, may expire
+        if (!tx_airtime_waiting_) {
+          tx_airtime_waiting_ = true;
+          auto id = add_timer(
+              [this] {
+                tx_airtime_waiting_ = false;
+                tx_drain();
+              },
+              wait);
+          if (id == 0) tx_airtime_waiting_ = false;
+        }
+        break;
+      }
+
+      tx_busy_ = true;
+      send_frame((message_type)type, frame, cost, AllIfaces);
+      tx_queue_.pop();
+    }
+    tx_draining_ = false;
+  }
+
+  void set_tx_done_handle(tx_done_handle_t handle, std::true_type) {
+    impl_->set_tx_done_handle(std::move(handle));
+  }
+
+  void set_tx_done_handle(tx_done_handle_t, std::false_type) {}
+
+  static size_t data_size(const data_view* segs, size_t seg_num) {
+    size_t size = 0;
+    for (size_t i = 0; i < seg_num; ++i) {
+      size += segs[i].size();
+    }
+    return size;
+  }
+
+  void dispatch(const message_view& msg, lqs_t lqs) {
     // clang-format off
-    MESH_CORE_LOGD("=>: self: 0x%02X, type: %d, src: 0x%02X, dst: 0x%02X, next_hop: 0x%02X, seq: %u, ttl: %u, ts: 0x%08" PRIX32 ", lqs: %d, data: %s",
-                   addr_, (int)msg.type, msg.src, msg.dst, msg.next_hop, msg.seq, msg.ttl, msg.ts, lqs, msg.data.c_str());
+    MESH_CORE_LOGD("=>: self: 0x%02X, type: %d, src: 0x%02X, dst: 0x%02X, next_hop: 0x%02X, seq: %u, ttl: %u, ts: 0x%08" PRIX32 ", lqs: %d, data: %.*s",
+                   addr_, (int)msg.type, msg.src, msg.dst, msg.next_hop, msg.seq, msg.ttl, msg.ts, lqs, (int)msg.data.size(), msg.data.data());
     // clang-format on
+    dispatch(msg, lqs, detail::feature<config::DispatchInterceptor>{});
+  }
 
-#ifdef MESH_CORE_ENABLE_DISPATCH_INTERCEPTOR
+  void dispatch(const message_view& msg, lqs_t lqs, std::false_type) {
+    dispatch_(msg, lqs);
+  }
+
+  void dispatch(const message_view& msg, lqs_t lqs, std::true_type) {
     /// interceptor
     if (dispatch_interceptor_) {
-      bool should_continue = dispatch_interceptor_(msg);
+      message m = msg.to_message();
+      bool should_continue = dispatch_interceptor_(m);
       if (!should_continue) {
         MESH_CORE_LOGD("dispatch: interceptor abort");
+        MESH_CORE_STATS(count_drop(stats, drop_reason::interceptor));
         return;
       }
+      dispatch_(message_view::from(m), lqs);
+      return;
     }
-#endif
+    dispatch_(msg, lqs);
+  }
+
+  void dispatch_(const message_view& msg, lqs_t lqs) {
+    /// implicit ack, before filter since it is a duplicate
+    hop_ack_on_copy(msg, detail::feature<config::HopAck>{});
+    if (msg.type == message_type::hop_ack) return;
 
     /// filter
-    if (!message_filter(msg)) {
+    if (!message_filter(msg, lqs)) {
       return;
     }
 
@@ -282,189 +1157,476 @@ class mesh : detail::noncopyable {
 #ifdef MESH_CORE_LOG_SHOW_DEBUG
         dump_debug();
 #endif
+        update_mpr();
         if (msg.type == message_type::route_info_and_request) {
           sync_route(false);
         }
+        trigger_route_update();
         return;
       } break;
       case message_type::route_debug_send:
-      case message_type::route_debug_back:
+      case message_type::route_debug_back: {
+        dispatch_route_debug(msg, detail::feature<config::RouteDebug>{});
+        return;
+      } break;
       case message_type::user_data: {
-        dispatch_userdata(std::move(msg));
+        dispatch_userdata(msg);
+        return;
+      } break;
+      case message_type::fragment: {
+        dispatch_fragment(msg);
+        return;
+      } break;
+      case message_type::reliable_data:
+      case message_type::reliable_ack: {
+        dispatch_reliable(msg);
         return;
       } break;
       case message_type::broadcast:
       case message_type::sync_time: {
-        dispatch_any_broadcast(std::move(msg));
+        dispatch_any_broadcast(msg, lqs);
         return;
       } break;
+      default: {
+        MESH_CORE_LOGD("drop: unknown type: %d", (int)msg.type);
+        MESH_CORE_STATS(count_drop(stats, drop_reason::unknown_type));
+      } break;
     }
   }
 
-  void dispatch_route_info(const message& message, lqs_t lqs) {
-    auto route_msg_ptr = (route_msg*)(message.data.data());
+  void dispatch_route_info(const message_view& message, lqs_t lqs) {
+    auto route_msg_ptr = (const route_msg*)(message.data.data());
     int route_msg_num = (int)(message.data.size() / sizeof(route_msg));
 
     MESH_CORE_LOGD("update route info: size: %d", route_msg_num);
     for (int i = 0; i < route_msg_num; ++i) {
       auto route_msg = route_msg_ptr + i;
       MESH_CORE_LOGD("dst: 0x%02X, next_hop: 0x%02X, metric: %d", route_msg->dst, route_msg->next_hop, route_msg->metric);
-      if (route_msg->next_hop == this->addr_) {
-        MESH_CORE_LOGD("ignore next_hop is self");
+      uint8_t metric = route_msg->metric & route_msg::MetricMask;
+      mpr_learn(message.src, *route_msg, detail::feature<config::Mpr>{});
+      if (route_msg->dst == this->addr_) {
+        continue;
+      }
+      auto info_old = route_table_.find_node(route_msg->dst);
+      // the sender is our next hop, its route is authoritative
+      bool from_next_hop = info_old && info_old->next_hop == message.src && info_old->iface == rx_iface_ && info_old->type == route_type::DYNAMIC;
+
+      uint8_t cost = interfaces_[rx_iface_].cost;
+      /// poison reverse(sender route via me) or withdrawal(metric infinite)
+      if (route_msg->next_hop == this->addr_ || metric + cost >= MESH_CORE_TTL_DEFAULT) {
+        if (from_next_hop) {
+          MESH_CORE_LOGD("withdraw route: 0x%02X", route_msg->dst);
+          route_table_.withdraw(route_msg->dst, get_timestamp());
+          MESH_CORE_STATS(++stats.route_withdrawals);
+        } else {
+          MESH_CORE_LOGD("ignore unreachable");
+        }
         continue;
       }
-      if (route_msg->metric >= MESH_CORE_TTL_DEFAULT) {
-        MESH_CORE_LOGD("ignore metric max");
+      if (info_old == nullptr && route_table_.held_down(route_msg->dst, message.src, get_timestamp(), config::RouteHoldDownMs)) {
+        MESH_CORE_LOGD("ignore hold down: 0x%02X", route_msg->dst);
         continue;
       }
-      auto info_old = route_table_.find_node(route_msg->dst);
+
       route_info info_new;
       info_new.dst = route_msg->dst;
-      info_new.next_hop = route_msg->next_hop;
-      info_new.metric = route_msg->metric + 1;
-      info_new.lqs = lqs;
+      info_new.next_hop = message.src;
+      info_new.metric = metric + cost;
+      info_new.lqs = route_table_.degraded(message.src, get_timestamp(), config::RouteDegradeMs) ? std::numeric_limits<lqs_t>::min() : lqs;
       info_new.expired = get_timestamp();
+      info_new.iface = rx_iface_;
       if (info_old == nullptr) {
         route_table_.add(info_new);
+        MESH_CORE_STATS(++stats.route_adds);
+      } else if (from_next_hop) {
+        if (info_new.metric != info_old->metric) {
+          MESH_CORE_STATS(++stats.route_changes);
+        }
+        route_table_.add(info_new);
+      } else if ((info_new.metric < info_old->metric) || (info_new.metric == info_old->metric && info_new.lqs > info_old->lqs)) {
+        route_table_.add(info_new);
+        MESH_CORE_STATS(++stats.route_changes);
       } else {
-        if ((info_new.metric < info_old->metric) || (info_new.metric == info_old->metric && info_new.lqs > info_old->lqs)) {
-          *info_old = info_new;
-        } else if (info_new.metric == info_old->metric) {
-          info_old->expired = get_timestamp();
-        } else {
-          MESH_CORE_LOGD("ignore route item");
+        MESH_CORE_LOGD("ignore route item");
+      }
+    }
+  }
+
+  void dispatch_userdata(const message_view& msg) {
+    if (msg.dst == this->addr_) {
+      if (on_recv_handle_) on_recv_handle_(msg.src, msg.data);
+      return;
+    }
+    forward(msg);
+  }
+
+  void dispatch_fragment(const message_view& msg) {
+    if (msg.dst != this->addr_) {
+      forward(msg);
+      return;
+    }
+    dispatch_fragment(msg, detail::feature<config::Fragment>{});
+  }
+
+  void dispatch_fragment(const message_view&, std::false_type) {
+    MESH_CORE_LOGD("drop: fragment disabled");
+    MESH_CORE_STATS(count_drop(stats, drop_reason::unknown_type));
+  }
+
+  void dispatch_fragment(const message_view& msg, std::true_type) {
+    fragment_msg frag;
+    if (msg.data.size() < sizeof(frag)) {
+      MESH_CORE_LOGD("drop: fragment size error");
+      MESH_CORE_STATS(count_drop(stats, drop_reason::fragment_error));
+      return;
+    }
+    memcpy(&frag, msg.data.data(), sizeof(frag));
+    data_view data(msg.data.data() + sizeof(frag), msg.data.size() - sizeof(frag));
+
+    bool stream = (bool)on_recv_fragment_handle_;
+    data_view payload;
+    uint32_t dropped = 0;
+    auto ret = reassembly_.add(get_timestamp(), msg.src, frag, data, !stream, payload, dropped, config::ReassemblyTimeoutMs);
+    MESH_CORE_STATS(stats.drops[(int)drop_reason::reassembly_timeout] += dropped);
+    switch (ret) {
+      case reassembly_t::result::ok:
+      case reassembly_t::result::complete: {
+        bool complete = ret == reassembly_t::result::complete;
+        if (stream) {
+          fragment_info info{frag.id, frag.index, frag.count, (uint32_t)frag.index * FragmentSizeMax, complete};
+          on_recv_fragment_handle_(msg.src, info, data);
+        } else if (complete && on_recv_handle_) {
+          on_recv_handle_(msg.src, payload);
         }
+      } break;
+      case reassembly_t::result::duplicate: {
+        MESH_CORE_STATS(count_drop(stats, drop_reason::duplicate));
+      } break;
+      case reassembly_t::result::error: {
+        MESH_CORE_LOGD("drop: fragment error, src: 0x%02X, index: %u/%u", msg.src, frag.index, frag.count);
+        MESH_CORE_STATS(count_drop(stats, drop_reason::fragment_error));
+      } break;
+      case reassembly_t::result::full:
+      case reassembly_t::result::too_large: {
+        MESH_CORE_LOGD("drop: reassembly full, src: 0x%02X", msg.src);
+        MESH_CORE_STATS(count_drop(stats, drop_reason::reassembly_full));
+      } break;
+    }
+  }
+
+  void dispatch_reliable(const message_view& msg) {
+    if (msg.dst != this->addr_) {
+      forward(msg);
+      return;
+    }
+    dispatch_reliable(msg, detail::feature<config::Reliable>{});
+  }
+
+  void dispatch_reliable(const message_view&, std::false_type) {
+    MESH_CORE_LOGD("drop: reliable disabled");
+    MESH_CORE_STATS(count_drop(stats, drop_reason::unknown_type));
+  }
+
+  void dispatch_reliable(const message_view& msg, std::true_type) {
+    if (msg.type == message_type::reliable_data) {
+      reliable_msg rm;
+      if (msg.data.size() < sizeof(rm)) {
+        MESH_CORE_LOGD("drop: reliable size error");
+        MESH_CORE_STATS(count_drop(stats, drop_reason::reliable_error));
+        return;
+      }
+      memcpy(&rm, msg.data.data(), sizeof(rm));
+      ack_msg ack;
+      bool fresh = reliable_rx_.on_data(get_timestamp(), msg.src, rm, ack);
+      // ack duplicates too, the last ack may be lost
+      ack.echo_ts = msg.ts;
+      data_view seg(&ack, sizeof(ack));
+      unicast(message_type::reliable_ack, msg.src, &seg, 1);
+      if (!fresh) {
+        MESH_CORE_LOGD("drop: reliable duplicate, src: 0x%02X, seq: %u", msg.src, rm.seq);
+        MESH_CORE_STATS(count_drop(stats, drop_reason::duplicate));
+        return;
+      }
+      if (on_recv_handle_) on_recv_handle_(msg.src, data_view(msg.data.data() + sizeof(rm), msg.data.size() - sizeof(rm)));
+    } else {
+      ack_msg ack;
+      if (msg.data.size() != sizeof(ack)) {
+        MESH_CORE_LOGD("drop: ack size error");
+        MESH_CORE_STATS(count_drop(stats, drop_reason::reliable_error));
+        return;
+      }
+      memcpy(&ack, msg.data.data(), sizeof(ack));
+      uint32_t acked = reliable_tx_.on_ack(get_timestamp(), msg.src, ack, get_timestamp() - ack.echo_ts);
+      for (int i = 0; i < (int)reliable_tx_t::Capacity; ++i) {
+        if ((acked >> i) & 1) finish_send_reliable(i, true);
       }
     }
   }
 
-  void dispatch_userdata(message msg) {
-#ifdef MESH_CORE_ENABLE_ROUTE_DEBUG
+  void dispatch_route_debug(const message_view& msg, std::false_type) {
+    if (msg.dst != this->addr_) forward(msg);
+  }
+
+  void dispatch_route_debug(const message_view& view, std::true_type) {
+    message msg = view.to_message();
     if (msg.type == message_type::route_debug_send) {
       msg.data.append(">" + std::to_string(addr_));
     } else if (msg.type == message_type::route_debug_back) {
       msg.data.append("<" + std::to_string(addr_));
     }
-#endif
 
     if (msg.dst == this->addr_) {
-      if (msg.type == message_type::user_data) {
-        if (on_recv_handle_) on_recv_handle_(msg.src, std::move(msg.data));
-      }
-#ifdef MESH_CORE_ENABLE_ROUTE_DEBUG
-      else if (msg.type == message_type::route_debug_send) {
-        if (on_recv_debug_handle_) on_recv_debug_handle_(msg.src, std::move(msg.data));
+      if (on_recv_debug_handle_) on_recv_debug_handle_(msg.src, msg.data);
+      if (msg.type == message_type::route_debug_send) {
         send_route_debug(msg.src, false);
-      } else if (msg.type == message_type::route_debug_back) {
-        if (on_recv_debug_handle_) on_recv_debug_handle_(msg.src, std::move(msg.data));
       }
-#endif
       return;
     }
+    forward(message_view::from(msg));
+  }
 
-#ifdef MESH_CORE_DISABLE_ROUTE
-    MESH_CORE_LOGD("drop: disable route");
-    return;
-#else
-    if (--msg.ttl == 0) {
+  void forward(const message_view& msg) {
+    if (!config::Route) {
+      MESH_CORE_LOGD("drop: disable route");
+      MESH_CORE_STATS(count_drop(stats, drop_reason::disable_route));
+      return;
+    }
+    ttl_t ttl = msg.ttl - 1;
+    if (ttl == 0) {
       MESH_CORE_LOGD("drop: ttl=0, src: 0x%02X, seq: %u", msg.src, msg.seq);
+      MESH_CORE_STATS(count_drop(stats, drop_reason::ttl_zero));
       return;
     }
     if (msg.next_hop != this->addr_) {
       MESH_CORE_LOGD("drop: route not me");
+      MESH_CORE_STATS(count_drop(stats, drop_reason::route_not_me));
       return;
     }
     auto info = route_table_.find_node(msg.dst);
     if (info == nullptr) {
       MESH_CORE_LOGD("drop: no route");
+      MESH_CORE_STATS(count_drop(stats, drop_reason::no_route));
       return;
     }
-    msg.next_hop = info->next_hop;
-    MESH_CORE_LOGD("next hop: 0x%02X, ttl = %u", msg.next_hop, msg.ttl);
-    broadcast(std::move(msg));
-#endif
+    message_header header = msg;
+    header.ttl = ttl;
+    header.next_hop = info->next_hop;
+    MESH_CORE_LOGD("next hop: 0x%02X, ttl = %u", header.next_hop, header.ttl);
+    MESH_CORE_STATS(++stats.forwards);
+    broadcast(header, &msg.data, 1);
   }
 
-  void dispatch_any_broadcast(message msg) {
+  void dispatch_any_broadcast(const message_view& msg, lqs_t lqs) {
     /// special message check
     if (msg.type == message_type::broadcast) {
-      if (on_recv_handle_) on_recv_handle_(msg.src, msg.data);  // do not move data
-    }
-#ifdef MESH_CORE_ENABLE_TIME_SYNC
-    else if (msg.type == message_type::sync_time) {
-      MESH_CORE_LOGD("sync ts: ttl=0, src: 0x%02X, seq: %u", msg.src, msg.seq);
-      if (time_sync_handle_) time_sync_handle_(msg.ts);
+      if (on_recv_handle_) on_recv_handle_(msg.src, msg.data);
+    } else if (msg.type == message_type::sync_time) {
+      dispatch_sync_time(msg, detail::feature<config::TimeSync>{});
     }
-#endif
 
     /// rebroadcast message
-#ifndef MESH_CORE_DISABLE_ROUTE
-    {
-      if (--msg.ttl == 0) {
-        MESH_CORE_LOGD("drop: ttl=0, src: 0x%02X, seq: %u", msg.src, msg.seq);
-        return;
-      }
+    rebroadcast(msg, lqs, detail::feature<config::Route>{});
+  }
 
-      MESH_CORE_LOGD("rebroadcast: ttl = %u", msg.ttl);
-      impl_->run_delay(
-          [this, msg = std::move(msg)]() mutable {
-            broadcast(std::move(msg));
-          },
-          random(DELAY_MIN, DELAY_MAX));
+  void dispatch_sync_time(const message_view& msg, std::true_type) {
+    MESH_CORE_LOGD("sync ts: ttl=0, src: 0x%02X, seq: %u", msg.src, msg.seq);
+    if (time_sync_handle_) time_sync_handle_(msg.ts);
+  }
+
+  void dispatch_sync_time(const message_view&, std::false_type) {}
+
+  void rebroadcast(const message_view&, lqs_t, std::false_type) {}
+
+  void rebroadcast(const message_view& msg, lqs_t lqs, std::true_type) {
+    ttl_t ttl = msg.ttl - 1;
+    if (ttl == 0) {
+      MESH_CORE_LOGD("drop: ttl=0, src: 0x%02X, seq: %u", msg.src, msg.seq);
+      MESH_CORE_STATS(count_drop(stats, drop_reason::ttl_zero));
+      return;
+    }
+
+    if (!mpr_relay(msg, detail::feature<config::Mpr>{})) {
+      MESH_CORE_LOGD("drop: not relay of 0x%02X", msg.next_hop);
+      MESH_CORE_STATS(count_drop(stats, drop_reason::not_relay));
+      return;
+    }
+
+    iface_mask_t egress = flood_ifaces(rx_iface_);
+    if (!egress) {
+      MESH_CORE_LOGD("no interface to rebroadcast");
+      return;
+    }
+
+    MESH_CORE_LOGD("rebroadcast: ttl = %u", ttl);
+    message_header header = msg;
+    header.ttl = ttl;
+    header.next_hop = addr_;
+    typename frame_pool_t::handle fh{};
+    auto ret = frame_pool_.alloc(msg.data, fh);
+    if (ret == frame_pool_t::result::full) {
+      MESH_CORE_LOGD("drop: frame pool full, src: 0x%02X, seq: %u", msg.src, msg.seq);
+      MESH_CORE_STATS(count_drop(stats, drop_reason::pool_full));
+      return;
+    }
+    if (ret == frame_pool_t::result::evicted) {
+      MESH_CORE_LOGD("frame pool full, oldest evicted");
+      MESH_CORE_STATS(++stats.pool_evictions);
+    }
+    typename rebroadcast_table_t::handle h{};
+    bool cancelable = relay_mode_ == relay_mode::counter && rebroadcast_table_.add(msg.src, msg.seq, lqs, h);
+    auto id = add_timer(
+        [this, header, fh, h, cancelable, egress]() mutable {
+          data_view data;
+          if (!frame_pool_.get(fh, data)) {
+            // evicted, counted already
+            if (cancelable) rebroadcast_table_.take(h);
+            return;
+          }
+          if (cancelable && !rebroadcast_table_.take(h)) {
+            MESH_CORE_LOGD("rebroadcast cancelled: src: 0x%02X, seq: %u", header.src, header.seq);
+            frame_pool_.release(fh);
+            return;
+          }
+          MESH_CORE_STATS(++stats.rebroadcasts);
+          broadcast(header, &data, 1, egress);
+          frame_pool_.release(fh);
+        },
+        random(config::DelayMsMin, config::DelayMsMax));
+    if (id == 0) {
+      frame_pool_.release(fh);
+      if (cancelable) rebroadcast_table_.take(h);
+      MESH_CORE_STATS(count_drop(stats, drop_reason::no_timer));
     }
-#endif
   }
 
   uint32_t random(uint32_t l, uint32_t r) {
     return utils::time_based_random(impl_->get_timestamp_ms() + addr_ + seq_, l, r);
   }
 
-  bool message_filter(message& msg) {
+  bool message_filter(const message_view& msg, lqs_t lqs) {
     /// self check
     if (msg.src == this->addr_) {
       MESH_CORE_LOGD("filter: self msg");
+      MESH_CORE_STATS(count_drop(stats, drop_reason::self_msg));
       return false;
     }
 
     /// ttl check
     if (msg.ttl > TTL_DEFAULT) {
       MESH_CORE_LOGD("filter: ttl error: %u", msg.ttl);
+      MESH_CORE_STATS(count_drop(stats, drop_reason::ttl_error));
       return false;
     }
 
-    /// cache manager
-    auto uuid = msg.cal_uuid();
-    if (msg_uuid_cache_.exists(uuid)) {
-      MESH_CORE_LOGD("filter: msg is old, src: 0x%02X, seq: %u, uuid: 0x%08" PRIX32, msg.src, msg.seq, uuid);
+    /// duplicate check
+    if (!dup_filter_.check_and_put(msg.src, msg.seq, msg.ts, config::DupExpiredMs)) {
+      MESH_CORE_LOGD("filter: msg is old, src: 0x%02X, seq: %u, uuid: 0x%08" PRIX64, msg.src, msg.seq, (uint64_t)msg.cal_uuid());
+      MESH_CORE_STATS(count_drop(stats, drop_reason::duplicate));
+      hop_ack_echo(msg, detail::feature<config::HopAck>{});
+      if (relay_mode_ == relay_mode::counter && (msg.type == message_type::broadcast || msg.type == message_type::sync_time)) {
+        rebroadcast_on_copy(msg, lqs, detail::feature<config::Route>{});
+      }
       return false;
     }
-    msg_uuid_cache_.put(uuid);
     return true;
   }
 
+  void rebroadcast_on_copy(const message_view& msg, lqs_t lqs, std::true_type) {
+    if (rebroadcast_table_.on_copy(msg.src, msg.seq, lqs, config::RebroadcastCounterThreshold, config::RebroadcastLqsMargin)) {
+      MESH_CORE_LOGD("rebroadcast suppressed: src: 0x%02X, seq: %u", msg.src, msg.seq);
+      MESH_CORE_STATS(++stats.rebroadcasts_suppressed);
+    }
+  }
+
+  void rebroadcast_on_copy(const message_view&, lqs_t, std::false_type) {}
+
+  template <typename F>
+  void count_stats(F&& f) {
+    count_stats(std::forward<F>(f), detail::feature<config::Stats>{});
+  }
+
+  template <typename F>
+  void count_stats(F&& f, std::true_type) {
+    f(stats_);
+  }
+
+  template <typename F>
+  void count_stats(F&&, std::false_type) {}
+
+  static void count_drop(mesh_stats& stats, drop_reason reason) {
+    ++stats.drops[(int)reason];
+  }
+
+  static void count_traffic(mesh_stats::traffic* traffic, message_type type, size_t size) {
+    auto& t = traffic[(int)type & (mesh_stats::TypeNum - 1)];
+    ++t.frames;
+    t.bytes += (uint32_t)size;
+  }
+
  private:
   Impl* impl_{};
   addr_t addr_{};
   seq_t seq_{};
-  detail::lru_record<msg_uuid_t> msg_uuid_cache_{LRU_RECORD_SIZE};
-  route_table route_table_;
+  detail::dup_filter<config::DupWindowSize, config::DupSourceNum> dup_filter_;
+  // pending rebroadcast data
+  using rebroadcast_table_t = detail::rebroadcast_table<config::RebroadcastPendingNum>;
+  using frame_pool_t = detail::frame_pool<frame_size::DataMax, config::FramePoolNum>;
+  detail::member_if<config::Route, rebroadcast_table_t> rebroadcast_table_;
+  detail::member_if<config::Route, frame_pool_t> frame_pool_;
+  using route_table_t = basic_route_table<config::Route ? config::RouteTableSize : config::LeafRouteTableSize, config::RouteDegradeNum>;
+  route_table_t route_table_;
+  bool dv_routing_{};
+  relay_mode relay_mode_{relay_mode::counter};
+  interface_config interfaces_[InterfaceNum];
+  iface_t rx_iface_{};  // of the frame being dispatched
+
+  using tx_queue_t = typename std::conditional<detail::has_tx_done<Impl>::value, detail::tx_queue<frame_size::Max, config::TxQueueNum>, detail::tx_queue_none>::type;
+  tx_queue_t tx_queue_;
+  bool tx_busy_{};
+  bool tx_draining_{};
+  bool tx_airtime_waiting_{};
+  detail::airtime_budget airtime_;
+
+  detail::basic_timer_wheel<config::TimerNum> timer_;
+  bool timer_armed_{};
+  timestamp_t timer_deadline_{};
+  std::shared_ptr<bool> alive_;
+  using mpr_t = detail::member_if<config::Mpr, detail::mpr_selector>;
+  mpr_t mpr_;
+  bool route_update_pending_{};
+  timestamp_t route_update_ts_{};
   on_recv_handle_t on_recv_handle_;
 
-#ifdef MESH_CORE_ENABLE_TIME_SYNC
-  time_sync_handle_t time_sync_handle_;
-#endif
+  detail::member_if<config::Stats, mesh_stats> stats_{};
 
-#ifdef MESH_CORE_ENABLE_ROUTE_DEBUG
-  on_recv_debug_handle_t on_recv_debug_handle_;
-#endif
+  detail::member_if<config::TimeSync, time_sync_handle_t> time_sync_handle_;
 
-#ifdef MESH_CORE_ENABLE_BROADCAST_INTERCEPTOR
-  broadcast_interceptor_t broadcast_interceptor_;
-#endif
+  detail::member_if<config::HopAck, detail::hop_ack_table<frame_size::Max, config::HopAckNum>> hop_acks_;
+  bool hop_ack_{true};
 
-#ifdef MESH_CORE_ENABLE_DISPATCH_INTERCEPTOR
-  dispatch_interceptor_t dispatch_interceptor_;
-#endif
+  using reliable_tx_t = detail::reliable_tx<ReliableSizeMax, config::ReliableTxNum, config::ReliablePeerNum, config::ReliableWindow>;
+  detail::member_if<config::Reliable, reliable_tx_t> reliable_tx_;
+  detail::member_if<config::Reliable, detail::reliable_rx<config::ReliablePeerNum>> reliable_rx_;
+
+  struct fragment_tx {
+    data_view data;
+    detail::timer_wheel::id_t timer;
+    timestamp_t ts;  // last progress
+    uint16_t index;
+    uint16_t count;
+    addr_t dst;
+    uint8_t id;
+    send_done_handle_t done;
+  };
+  detail::member_if<config::Fragment, fragment_tx> fragment_tx_{};
+  detail::member_if<config::Fragment, uint8_t> fragment_id_{};
+  using reassembly_t = detail::reassembly<FragmentSizeMax, config::ReassemblyNum, config::ReassemblySize>;
+  detail::member_if<config::Fragment, reassembly_t> reassembly_;
+  detail::member_if<config::Fragment, on_recv_fragment_handle_t> on_recv_fragment_handle_;
+
+  detail::member_if<config::RouteDebug, on_recv_debug_handle_t> on_recv_debug_handle_;
+  detail::member_if<config::BroadcastInterceptor, broadcast_interceptor_t> broadcast_interceptor_;
+  detail::member_if<config::DispatchInterceptor, dispatch_interceptor_t> dispatch_interceptor_;
 };
 
 }  // namespace mesh_core
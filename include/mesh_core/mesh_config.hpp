@@ -0,0 +1,167 @@
+#pragma once
+
+// config
+#include "config.hpp"
+#include "integrity.hpp"
+#include "type.hpp"
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace mesh_core {
+
+/**
+ * per instance configuration of `mesh<Impl, Config>`, so one binary can host instances with different profiles.
+ * values default to the MESH_CORE_* macros, derive from it and hide the ones to change:
+ *
+ * struct leaf_config : mesh_core::default_config {
+ *   static const bool Route = false;
+ *   static const mesh_core::ttl_t Ttl = 4;
+ * };
+ * mesh_core::mesh<Impl, leaf_config> leaf(&impl);
+ *
+ * disabled features have no storage and their api fails to compile, an instance with Route = false keeps a small
+ * hashed route table of LeafRouteTableSize slots for its own next hops.
+ * still global, see config.hpp:
+ * 1. the wire format: address and sequence width, magic, MESH_CORE_TTL_DEFAULT as the unreachable metric, fragment count
+ * 2. the tick of timers and airtime slots, the log
+ */
+struct default_config {
+  using integrity_type = integrity::crc16;
+
+  /// features
+#ifdef MESH_CORE_DISABLE_ROUTE
+  static const bool Route = false;
+#else
+  static const bool Route = true;  // forward and rebroadcast, learn and advertise routes
+#endif
+#ifdef MESH_CORE_ENABLE_TIME_SYNC
+  static const bool TimeSync = true;
+#else
+  static const bool TimeSync = false;
+#endif
+#ifdef MESH_CORE_ENABLE_ROUTE_DEBUG
+  static const bool RouteDebug = true;
+#else
+  static const bool RouteDebug = false;
+#endif
+#ifdef MESH_CORE_ENABLE_BROADCAST_INTERCEPTOR
+  static const bool BroadcastInterceptor = true;
+#else
+  static const bool BroadcastInterceptor = false;
+#endif
+#ifdef MESH_CORE_ENABLE_DISPATCH_INTERCEPTOR
+  static const bool DispatchInterceptor = true;
+#else
+  static const bool DispatchInterceptor = false;
+#endif
+#ifdef MESH_CORE_ENABLE_STATS
+  static const bool Stats = true;
+#else
+  static const bool Stats = false;
+#endif
+#ifdef MESH_CORE_ENABLE_MPR
+  static const bool Mpr = true;  // only for 8bit address
+#else
+  static const bool Mpr = false;
+#endif
+#ifdef MESH_CORE_ENABLE_FRAGMENT
+  static const bool Fragment = true;
+#else
+  static const bool Fragment = false;
+#endif
+#ifdef MESH_CORE_ENABLE_RELIABLE
+  static const bool Reliable = true;
+#else
+  static const bool Reliable = false;
+#endif
+#ifdef MESH_CORE_ENABLE_HOP_ACK
+  static const bool HopAck = true;
+#else
+  static const bool HopAck = false;
+#endif
+
+  /// hops of messages from this instance, <= MESH_CORE_TTL_DEFAULT which is also the unreachable metric of the mesh
+  static const ttl_t Ttl = MESH_CORE_TTL_DEFAULT;
+  /// random delay before rebroadcast and triggered route update
+  static const uint32_t DelayMsMin = MESH_CORE_DELAY_MS_MIN;
+  static const uint32_t DelayMsMax = MESH_CORE_DELAY_MS_MAX;
+
+  static const uint32_t RouteExpiredMs = MESH_CORE_ROUTE_EXPIRED_MS;
+  static const uint32_t RouteSyncIntervalMs = MESH_CORE_ROUTE_SYNC_INTERVAL_MS;
+  static const uint32_t RouteTriggerIntervalMs = MESH_CORE_ROUTE_TRIGGER_INTERVAL_MS;
+  static const uint32_t RouteCheckExpiredIntervalMs = MESH_CORE_ROUTE_CHECK_EXPIRED_INTERVAL_MS;
+  static const uint32_t RouteHoldDownMs = MESH_CORE_ROUTE_HOLD_DOWN_MS;
+  static const uint32_t RouteDegradeMs = MESH_CORE_ROUTE_DEGRADE_MS;
+  static const size_t RouteDegradeNum = MESH_CORE_ROUTE_DEGRADE_NUM;
+  /// power of 2, 256 for 8bit address is direct indexed
+  static const size_t RouteTableSize = sizeof(addr_t) == 1 ? 256 : MESH_CORE_ROUTE_TABLE_SIZE;
+  static const size_t LeafRouteTableSize = MESH_CORE_LEAF_ROUTE_TABLE_SIZE;  // instead of RouteTableSize if Route = false
+
+  static const size_t DupWindowSize = MESH_CORE_DUP_WINDOW_SIZE;
+  static const size_t DupSourceNum = MESH_CORE_DUP_SOURCE_NUM;  // only for 16bit address
+  static const uint32_t DupExpiredMs = MESH_CORE_DUP_EXPIRED_MS;
+  static const size_t RebroadcastPendingNum = MESH_CORE_REBROADCAST_PENDING_NUM;
+  static const uint8_t RebroadcastCounterThreshold = MESH_CORE_REBROADCAST_COUNTER_THRESHOLD;
+  static const int RebroadcastLqsMargin = MESH_CORE_REBROADCAST_LQS_MARGIN;
+  static const size_t FramePoolNum = MESH_CORE_FRAME_POOL_NUM;
+  static const size_t TimerNum = MESH_CORE_TIMER_NUM;
+  static const size_t TxQueueNum = MESH_CORE_TX_QUEUE_NUM;
+  static const uint32_t TxDeadlineMs = MESH_CORE_TX_DEADLINE_MS;
+  /// initial limit of `mesh::set_duty_cycle`
+  static const uint16_t DutyCyclePermille = MESH_CORE_DUTY_CYCLE_PERMILLE;
+  static const uint32_t DutyCycleWindowMs = MESH_CORE_DUTY_CYCLE_WINDOW_MS;
+  static const uint8_t AirtimeReservePercent = MESH_CORE_AIRTIME_RESERVE_PERCENT;
+
+  /// only used if the feature is enabled
+  static const uint32_t FragmentIntervalMs = MESH_CORE_FRAGMENT_INTERVAL_MS;
+  static const size_t ReassemblyNum = MESH_CORE_REASSEMBLY_NUM;
+  static const size_t ReassemblySize = MESH_CORE_REASSEMBLY_SIZE;
+  static const uint32_t ReassemblyTimeoutMs = MESH_CORE_REASSEMBLY_TIMEOUT_MS;
+  static const size_t ReliableTxNum = MESH_CORE_RELIABLE_TX_NUM;
+  static const size_t ReliableWindow = MESH_CORE_RELIABLE_WINDOW;
+  static const size_t ReliablePeerNum = MESH_CORE_RELIABLE_PEER_NUM;
+  static const uint8_t ReliableRetry = MESH_CORE_RELIABLE_RETRY;
+  static const uint32_t ReliableRtoInitMs = MESH_CORE_RELIABLE_RTO_INIT_MS;
+  static const uint32_t ReliableRtoMinMs = MESH_CORE_RELIABLE_RTO_MIN_MS;
+  static const uint32_t ReliableRtoMaxMs = MESH_CORE_RELIABLE_RTO_MAX_MS;
+  static const size_t HopAckNum = MESH_CORE_HOP_ACK_NUM;
+  static const uint32_t HopAckTimeoutMs = MESH_CORE_HOP_ACK_TIMEOUT_MS;
+  static const uint8_t HopAckRetry = MESH_CORE_HOP_ACK_RETRY;
+};
+
+namespace detail {
+
+/**
+ * the second parameter of mesh is a Config, or an integrity policy for default config with it
+ */
+template <typename Integrity>
+struct integrity_config : default_config {
+  using integrity_type = Integrity;
+};
+
+template <typename T, typename = void>
+struct config_of {
+  using type = integrity_config<T>;
+};
+
+template <typename T>
+struct config_of<T, decltype(std::declval<typename T::integrity_type>(), void())> {
+  using type = T;
+};
+
+template <bool Enable>
+using feature = std::integral_constant<bool, Enable>;
+
+/**
+ * storage of a member only if the feature is enabled
+ */
+struct none {};
+
+template <bool Enable, typename T>
+using member_if = typename std::conditional<Enable, T, none>::type;
+
+}  // namespace detail
+}  // namespace mesh_core
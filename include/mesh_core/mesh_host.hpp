@@ -0,0 +1,434 @@
+#pragma once
+
+// first include
+#include "mesh_core/config.hpp"
+
+// other include
+#include "mesh_core/data_view.hpp"
+#include "mesh_core/detail/mpsc_ring.hpp"
+#include "mesh_core/detail/noncopyable.hpp"
+#include "mesh_core/detail/timer_wheel.hpp"
+#include "mesh_core/mesh.hpp"
+#include "mesh_core/mesh_config.hpp"
+#include "mesh_core/message.hpp"
+#include "mesh_core/type.hpp"
+
+// std
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace mesh_core {
+
+/**
+ * run many mesh instances(virtual nodes) in one process, sharded across worker threads, e.g. a gateway emulating a node per tenant.
+ *
+ * 1. each node belongs to one shard, a shard is a thread with its own clock, timer wheel and inbox, each mesh is still single-threaded
+ * 2. nodes linked by `link()` are radio neighbours, a frame is copied into the inbox of the neighbour's shard, no socket and no re-encoding
+ * 3. frames are delivered from the inbox, never inside `broadcast()`, so a mesh is not re-entered by its neighbours
+ * 4. the uplink of a node is called with its frames for the outside, `deliver()` injects frames from the outside
+ * 5. nodes and links are set up before `start()`, then run code on a node by `post()` from any thread
+ *
+ * not included by mesh_core.hpp, need threads and heap.
+ *
+ * @tparam Config of all nodes, see mesh_config.hpp
+ * @tparam ShardNodeNum max nodes of each shard
+ */
+template <typename Config = default_config, size_t ShardNodeNum = MESH_CORE_HOST_SHARD_NODE_NUM>
+class mesh_host : detail::noncopyable {
+  class node;
+  struct shard;
+
+ public:
+  using mesh_t = mesh<node, Config>;
+  // run on the shard thread of the node
+  using task_t = std::function<void(mesh_t&)>;
+  // frames from the node to the outside, on the shard thread
+  using uplink_t = std::function<void(data_view)>;
+  static const size_t InboxNum = MESH_CORE_HOST_INBOX_NUM;
+  static const uint16_t FrameSizeMax = message::frame_size<typename detail::config_of<Config>::type::integrity_type>::Max;
+
+ public:
+  /**
+   * @param threads 0 for hardware concurrency
+   */
+  explicit mesh_host(size_t threads = 0) {
+    if (threads == 0) threads = std::thread::hardware_concurrency();
+    if (threads == 0) threads = 1;
+    for (size_t i = 0; i < threads; ++i) {
+      shards_.emplace_back(new shard(now_ms()));
+    }
+  }
+
+  ~mesh_host() {
+    stop();
+  }
+
+  /**
+   * before `start()`, set handles of the mesh before `start()` too, `init()` is called by `start()` after all links are set
+   * @param shard_index -1 for round robin
+   * @return nullptr if started, addr exists or the shard is full
+   */
+  mesh_t* add_node(addr_t addr, int shard_index = -1) {
+    if (started_ || nodes_.count(addr)) return nullptr;
+    if (shard_index < 0) shard_index = (int)(nodes_.size() % shards_.size());
+    if ((size_t)shard_index >= shards_.size()) return nullptr;
+    auto& s = *shards_[shard_index];
+    if (s.nodes.size() == ShardNodeNum) {
+      MESH_CORE_LOGE("shard %d full", shard_index);
+      return nullptr;
+    }
+    std::unique_ptr<node> n(new node(this, &s, addr));
+    n->mesh.reset(new mesh_t(n.get()));
+    s.nodes.push_back(n.get());
+    auto* m = n->mesh.get();
+    nodes_[addr] = std::move(n);
+    return m;
+  }
+
+  /**
+   * before `start()`, make a and b neighbours
+   * @param lqs link quality of both directions
+   */
+  bool link(addr_t a, addr_t b, lqs_t lqs = 0) {
+    if (started_ || a == b) return false;
+    node* na = find(a);
+    node* nb = find(b);
+    if (!na || !nb) return false;
+    na->links.push_back({nb, lqs});
+    nb->links.push_back({na, lqs});
+    return true;
+  }
+
+  /**
+   * before `start()`
+   */
+  bool set_uplink(addr_t addr, uplink_t uplink) {
+    node* n = find(addr);
+    if (started_ || !n) return false;
+    n->uplink = std::move(uplink);
+    return true;
+  }
+
+  void start() {
+    if (started_) return;
+    started_ = true;
+    // before any worker, the first route requests reach every neighbour and no inbox overflows
+    for (auto& s : shards_) {
+      s->now = now_ms();
+    }
+    for (auto& s : shards_) {
+      for (auto* n : s->nodes) {
+        n->mesh->init(n->addr);
+        settle();
+      }
+    }
+    running_.store(true, std::memory_order_release);
+    for (auto& s : shards_) {
+      shard* sp = s.get();
+      s->thread = std::thread([this, sp] {
+        run(*sp);
+      });
+    }
+  }
+
+  /**
+   * join all workers, nodes are kept, queued frames and tasks are discarded
+   */
+  void stop() {
+    if (!running_.exchange(false)) return;
+    for (auto& s : shards_) {
+      std::lock_guard<std::mutex> lock(s->mutex);
+      s->cv.notify_one();
+    }
+    for (auto& s : shards_) {
+      if (s->thread.joinable()) s->thread.join();
+    }
+  }
+
+  /**
+   * any thread, run task on the shard thread of the node
+   * @return false if no such node or the inbox is full
+   */
+  bool post(addr_t addr, task_t task) {
+    node* n = find(addr);
+    if (!n) return false;
+    bool ok = n->owner->inbox.push([&](item& it) {
+      it.to = n;
+      it.task = std::move(task);
+    });
+    if (!ok) return false;
+    wake(*n->owner);
+    return true;
+  }
+
+  /**
+   * any thread, a frame received by the node from the outside
+   * @return false if no such node, frame too large or the inbox is full
+   */
+  bool deliver(addr_t addr, data_view frame, lqs_t lqs = 0) {
+    node* n = find(addr);
+    if (!n || !push_frame(n, frame, lqs)) return false;
+    wake(*n->owner);
+    return true;
+  }
+
+  size_t node_num() const {
+    return nodes_.size();
+  }
+
+  size_t shard_num() const {
+    return shards_.size();
+  }
+
+  /**
+   * @return -1 if no such node
+   */
+  int shard_of(addr_t addr) const {
+    auto it = nodes_.find(addr);
+    if (it == nodes_.end()) return -1;
+    for (size_t i = 0; i < shards_.size(); ++i) {
+      if (shards_[i].get() == it->second->owner) return (int)i;
+    }
+    return -1;
+  }
+
+  /**
+   * any thread, frames delivered to nodes
+   */
+  uint64_t frames() const {
+    uint64_t n = 0;
+    for (auto& s : shards_) n += s->frames.load(std::memory_order_relaxed);
+    return n;
+  }
+
+  /**
+   * any thread, frames dropped for full inboxes
+   */
+  uint64_t drops() const {
+    uint64_t n = 0;
+    for (auto& s : shards_) n += s->drops.load(std::memory_order_relaxed);
+    return n;
+  }
+
+ private:
+  using wheel_t = detail::basic_timer_wheel<ShardNodeNum>;
+
+  struct link_t {
+    node* to;
+    lqs_t lqs;
+  };
+
+  /**
+   * Impl of each mesh, only used on its shard thread
+   */
+  class node : detail::noncopyable {
+   public:
+    node(mesh_host* host, shard* s, addr_t addr) : host_(host), owner(s), addr(addr) {}
+
+    void broadcast(data_view frame) {
+      for (const auto& l : links) {
+        host_->send_to(*owner, l.to, frame, l.lqs);
+      }
+      if (uplink) uplink(frame);
+    }
+
+    void set_recv_handle(recv_handle_t handle) {
+      recv = std::move(handle);
+    }
+
+    timestamp_t get_timestamp_ms() {
+      return owner->now;
+    }
+
+   private:
+    mesh_host* host_;
+
+   public:
+    shard* owner;
+    addr_t addr;
+    std::vector<link_t> links;
+    uplink_t uplink;
+    recv_handle_t recv;
+    typename wheel_t::id_t timer{};
+    timestamp_t deadline{};
+    // destroyed first, it points to this node as Impl, the handle left in `recv` does nothing after that
+    std::unique_ptr<mesh_t> mesh;
+  };
+
+  /**
+   * a frame or a task for a node
+   */
+  struct item {
+    node* to;
+    task_t task;  // empty for frame
+    lqs_t lqs;
+    uint16_t size;
+    uint8_t data[FrameSizeMax];
+  };
+
+  struct shard : detail::noncopyable {
+    explicit shard(timestamp_t now) : now(now), timer(now) {}
+
+    timestamp_t now;  // clock of all nodes in the shard, updated by each round
+    wheel_t timer;  // one timer per node, for its next poll
+    detail::mpsc_ring<item, InboxNum> inbox;
+    std::vector<node*> nodes;
+    std::atomic<bool> signaled{false};
+    std::atomic<uint64_t> frames{0};
+    std::atomic<uint64_t> drops{0};
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::thread thread;
+  };
+
+  static timestamp_t now_ms() {
+    return (timestamp_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  node* find(addr_t addr) const {
+    auto it = nodes_.find(addr);
+    return it == nodes_.end() ? nullptr : it->second.get();
+  }
+
+  bool push_frame(node* to, data_view frame, lqs_t lqs) {
+    if (frame.size() > FrameSizeMax) return false;
+    bool ok = to->owner->inbox.push([&](item& it) {
+      it.to = to;
+      it.lqs = lqs;
+      it.size = (uint16_t)frame.size();
+      memcpy(it.data, frame.data(), frame.size());
+    });
+    if (!ok) to->owner->drops.fetch_add(1, std::memory_order_relaxed);
+    return ok;
+  }
+
+  /**
+   * on the shard thread of `from`, a neighbour on the same shard only needs the next round
+   */
+  void send_to(shard& from, node* to, data_view frame, lqs_t lqs) {
+    if (!push_frame(to, frame, lqs)) return;
+    if (to->owner == &from) {
+      from.signaled.store(true);
+    } else {
+      wake(*to->owner);
+    }
+  }
+
+  /**
+   * only the first one after the shard starts a round takes the lock
+   */
+  void wake(shard& s) {
+    if (s.signaled.exchange(true)) return;
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.cv.notify_one();
+  }
+
+  /**
+   * no worker yet, deliver all frames on this thread
+   */
+  void settle() {
+    bool busy = true;
+    while (busy) {
+      busy = false;
+      for (auto& s : shards_) {
+        while (s->inbox.pop([&](item& it) {
+          handle(*s, it);
+        })) {
+          busy = true;
+        }
+        s->inbox.sync_tail();
+      }
+    }
+  }
+
+  /**
+   * worker: deliver the inbox, poll due nodes, then sleep until the next timer or a wake
+   */
+  void run(shard& s) {
+    s.now = now_ms();
+    for (auto* n : s.nodes) {
+      schedule(s, *n);
+    }
+    while (running_.load(std::memory_order_acquire)) {
+      // before reading the inbox, so a push after it wakes the next round
+      s.signaled.store(false);
+      s.now = now_ms();
+      size_t num = 0;
+      while (num < InboxNum && s.inbox.pop([&](item& it) {
+        handle(s, it);
+      })) {
+        ++num;
+      }
+      s.inbox.sync_tail();
+      if (num == InboxNum) s.signaled.store(true);
+      s.timer.poll(s.now);
+
+      uint32_t timeout = s.timer.next_timeout(s.now);
+      std::unique_lock<std::mutex> lock(s.mutex);
+      auto ready = [&] {
+        return s.signaled.load() || !running_.load(std::memory_order_acquire);
+      };
+      if (timeout == UINT32_MAX) {
+        s.cv.wait(lock, ready);
+      } else {
+        s.cv.wait_for(lock, std::chrono::milliseconds(timeout), ready);
+      }
+    }
+  }
+
+  void handle(shard& s, item& it) {
+    node& n = *it.to;
+    if (it.task) {
+      it.task(*n.mesh);
+      it.task = nullptr;
+    } else {
+      s.frames.fetch_add(1, std::memory_order_relaxed);
+      if (n.recv) n.recv(data_view(it.data, it.size), it.lqs);
+    }
+    schedule(s, n);
+  }
+
+  /**
+   * keep one shard timer per node at the deadline of its mesh timers
+   */
+  void schedule(shard& s, node& n) {
+    uint32_t timeout = n.mesh->next_timeout();
+    if (timeout == UINT32_MAX) {
+      s.timer.cancel(n.timer);
+      n.timer = 0;
+      return;
+    }
+    timestamp_t deadline = s.now + timeout;
+    if (n.timer && deadline == n.deadline) return;
+    s.timer.cancel(n.timer);
+    n.deadline = deadline;
+    node* np = &n;
+    n.timer = s.timer.add(
+        s.now, timeout,
+        [this, &s, np] {
+          np->timer = 0;
+          np->mesh->poll();
+          schedule(s, *np);
+        });
+    if (n.timer == 0) MESH_CORE_LOGE("no free shard timer");
+  }
+
+ private:
+  std::vector<std::unique_ptr<shard>> shards_;
+  std::unordered_map<addr_t, std::unique_ptr<node>> nodes_;
+  bool started_{false};
+  std::atomic<bool> running_{false};
+};
+
+}  // namespace mesh_core
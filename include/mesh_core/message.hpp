@@ -4,12 +4,18 @@
 #include "mesh_core/config.hpp"
 
 // other include
+#include "mesh_core/data_view.hpp"
 #include "mesh_core/detail/copyable.hpp"
+#include "mesh_core/detail/log.h"
 #include "mesh_core/detail/noncopyable.hpp"
+#include "mesh_core/integrity.hpp"
+#include "mesh_core/stats.hpp"
 #include "mesh_core/type.hpp"
 #include "mesh_core/utils.hpp"
 
 // std
+#include <cstddef>
+#include <cstring>
 #include <string>
 
 namespace mesh_core {
@@ -21,21 +27,23 @@ namespace mesh_core {
 /// │ 1       │ ver          │ 0x00              │ Protocol version              │
 /// │ 1       │ len          │ 0x00              │ Payload length in bytes       │
 /// ├─────────┼──────────────┼───────────────────┼───────────────────────────────┤
-/// │ 1/2     │ type         │ 0x0               │ Message type                  │
-/// │ 1/2     │ ttl          │ 0x0               │ Hops                          │
+/// │ 1/2(1)  │ type         │ 0x0               │ Message type                  │
+/// │ 1/2(1)  │ ttl          │ 0x0               │ Hops                          │
 /// ├─────────┼──────────────┼───────────────────┼───────────────────────────────┤
-/// │ 1       │ src          │ 0x00              │ Source address                │
-/// │ 1       │ dst          │ 0x00              │ Destination address           │
-/// │ 1       │ seq          │ 0x00              │ Sequence number               │
+/// │ 1(2)    │ src          │ 0x00              │ Source address                │
+/// │ 1(2)    │ dst          │ 0x00              │ Destination address           │
+/// │ 1(2)    │ seq          │ 0x00              │ Sequence number               │
 /// │ 4       │ ts           │ 0x00000000        │ Timestamp for milliseconds    │
 /// ├─────────┼──────────────┼───────────────────┼───────────────────────────────┤
 /// │ n       │ route_infos  │ [variable]        │ Route info list               │
 /// │---------│--------------│-------------------│-------------------------------│
-/// │ 1       │ next_hop     │ 0x00              │ Next hop                      │
+/// │ 1(2)    │ next_hop     │ 0x00              │ Next hop, last hop(broadcast) │
 /// │ n       │ data         │ [variable]        │ Payload for user data         │
 /// ├─────────┼──────────────┼───────────────────┼───────────────────────────────┤
 /// │ 2       │ crc          │ 0x0000            │ CRC-16 of all preceding fields│
+/// │         │              │                   │ (0/2/4 by integrity policy)   │
 /// └─────────┴──────────────┴───────────────────┴───────────────────────────────┘
+/// (n): size for 16bit address or sequence, see proto_traits
 
 enum class message_type : uint8_t {
   route_info = 0,
@@ -45,12 +53,18 @@ enum class message_type : uint8_t {
   user_data = 4,
   route_debug_send = 5,
   route_debug_back = 6,
+  fragment = 7,
+  reliable_data = 8,
+  reliable_ack = 9,
+  hop_ack = 10,  // header only, consumed by the last hop, never filtered or forwarded
 };
 
-struct message : detail::copyable {
+struct message;
+
+struct message_header : detail::copyable {
   // header
   uint8_t head = MESH_CORE_MSG_MAGIC;  // Mesh Core
-  uint8_t ver = MESH_CORE_PROTO_VER;
+  uint8_t ver = proto::ProtoVer;
   uint8_t len{};
   message_type type{};
   ttl_t ttl{};
@@ -60,128 +74,278 @@ struct message : detail::copyable {
   timestamp_t ts{};
 
   addr_t next_hop{};  // only for userdata and some type
-  data_t data;        // userdata or route_infos
 
-  uint16_t crc{};
+  uint32_t crc{};  // integrity check value, crc16 by default
 
  public:
+  // type and ttl share one byte if narrow
+  static const uint8_t SizeTypeTtl = proto::Narrow ? 1 : 2;
   // clang-format off
-  // message min size(without data): 13 bytes
-  static const uint8_t SizeMin = sizeof(head) + sizeof(ver) + sizeof(len) + sizeof(ttl) + sizeof(src) + sizeof(dst)+ sizeof(seq) + sizeof(ts) + sizeof(crc);
+  // header size(without next_hop, data and integrity check): 11 bytes for 8bit address and sequence
+  static const uint8_t SizeHeader = sizeof(head) + sizeof(ver) + sizeof(len) + SizeTypeTtl + sizeof(src) + sizeof(dst)+ sizeof(seq) + sizeof(ts);
   // clang-format on
   static const uint8_t SizeNotInLen = sizeof(head) + sizeof(ver) + sizeof(len);
-  // message data max size: 250 bytes
-  static const uint8_t DataSizeMax = (sizeof(len) << 8) - SizeNotInLen - sizeof(crc) - sizeof(next_hop);
-  static const uint16_t SizeMax = SizeMin + DataSizeMax;
+
+  /**
+   * frame size with integrity policy
+   */
+  template <typename Integrity>
+  struct frame_size {
+    // message min size(without data)
+    static const uint8_t Min = SizeHeader + Integrity::Size;
+    // len is uint8_t, count all bytes after it
+    static const uint16_t Max = SizeNotInLen + 0xFF;
+    // message data max size, next_hop may exist
+    static const uint8_t DataMax = Max - Min - sizeof(addr_t);
+  };
+
+  // message min size(without data): 13 bytes for 8bit address and sequence
+  static const uint8_t SizeMin = frame_size<integrity::crc16>::Min;
+  // message data max size: 244 bytes for 8bit address and sequence
+  static const uint8_t DataSizeMax = frame_size<integrity::crc16>::DataMax;
+  static const uint16_t SizeMax = frame_size<integrity::crc16>::Max;
 
  public:
   msg_uuid_t cal_uuid() const {
-    static_assert(std::is_same<msg_uuid_t, uint32_t>::value, "");
-    static_assert(std::is_same<ttl_t, uint8_t>::value, "");
     static_assert(std::is_same<timestamp_t, uint32_t>::value, "");
     // uuid: {src|seq|ts}, ts is for ensure message is unique after reboot
-    return (src << 24) | (seq << 16) | (uint16_t(ts & 0x0000FFFF));
+    return ((msg_uuid_t)src << ((sizeof(seq) + 2) * 8)) | ((msg_uuid_t)seq << 16) | (uint16_t(ts & 0x0000FFFF));
+  }
+
+  static bool has_next_hop(const message_header& msg) {
+    return msg.type != message_type::route_info && msg.type != message_type::route_info_and_request;
+  }
+
+  /**
+   * serialize header and gather data segments into frame buffer in one pass, also update len and crc
+   * @param out frame buffer, `frame_size<Integrity>::Max` is enough for any message
+   * @param segs data segments
+   * @return frame size, 0 for error
+   */
+  template <typename Integrity = integrity::crc16>
+  size_t serialize_into(uint8_t* out, size_t cap, const data_view* segs, size_t seg_num) {
+    size_t data_size = 0;
+    for (size_t i = 0; i < seg_num; ++i) {
+      data_size += segs[i].size();
+    }
+    if (data_size > frame_size<Integrity>::DataMax) {
+      return 0;
+    }
+    size_t size = frame_size<Integrity>::Min + data_size + (has_next_hop(*this) ? sizeof(next_hop) : 0);
+    if (size > cap) {
+      return 0;
+    }
+    len = size - SizeNotInLen;
+
+    uint8_t* p = out;
+    write(p, head);
+    write(p, ver);
+    write(p, len);
+    if (proto::Narrow) {
+      uint8_t type_ttl = ((uint8_t)type << 4) | ttl;
+      write(p, type_ttl);
+    } else {
+      write(p, (uint8_t)type);
+      write(p, ttl);
+    }
+    write(p, src);
+    write(p, dst);
+    write(p, seq);
+    write(p, ts);
+    if (has_next_hop(*this)) {
+      write(p, next_hop);
+    }
+    for (size_t i = 0; i < seg_num; ++i) {
+      if (segs[i].size()) {
+        memcpy(p, segs[i].data(), segs[i].size());
+        p += segs[i].size();
+      }
+    }
+    crc = Integrity::calc(out, p - out);
+    write_check<Integrity>(p, crc);
+    return size;
+  }
+
+ private:
+  template <typename Integrity>
+  static void write_check(uint8_t*& p, uint32_t check) {
+    if (Integrity::Size == 2) {
+      write(p, (uint16_t)check);
+    } else if (Integrity::Size == 4) {
+      write(p, check);
+    }
+  }
+
+  template <typename T>
+  static void write(uint8_t*& p, const T& value) {
+    memcpy(p, &value, sizeof(value));
+    p += sizeof(value);
+  }
+};
+
+struct message : message_header {
+  data_t data;  // userdata or route_infos
+
+ public:
+  using message_header::serialize_into;
+
+  /**
+   * @param out frame buffer, `SizeMax` is enough for any message
+   * @return frame size, 0 for error
+   */
+  template <typename Integrity = integrity::crc16>
+  size_t serialize_into(uint8_t* out, size_t cap) {
+    data_view seg(data);
+    return message_header::serialize_into<Integrity>(out, cap, &seg, 1);
   }
 
+  template <typename Integrity = integrity::crc16>
   std::string serialize(bool& ok) {
-    if (data.size() > DataSizeMax) {
-      ok = false;
+    uint8_t buffer[frame_size<Integrity>::Max];
+    size_t size = serialize_into<Integrity>(buffer, sizeof(buffer));
+    ok = size != 0;
+    if (!ok) {
       return {};
     }
-    finalize();
-    std::string payload;
-    payload.reserve(SizeMin + data.size());
-    payload.append((char*)&head, sizeof(head));
-    payload.append((char*)&ver, sizeof(ver));
-    payload.append((char*)&len, sizeof(len));
-    uint8_t type_ttl = ((uint8_t)type << 4) | ttl;
-    payload.append((char*)&type_ttl, sizeof(type_ttl));
-    payload.append((char*)&src, sizeof(src));
-    payload.append((char*)&dst, sizeof(dst));
-    payload.append((char*)&seq, sizeof(seq));
-    payload.append((char*)&ts, sizeof(ts));
+    return {(char*)buffer, size};
+  }
+
+  template <typename Integrity = integrity::crc16>
+  static message deserialize(data_view payload, bool& ok);
+
+  void finalize() {
+    len = SizeMin + data.size() - SizeNotInLen;
     if (has_next_hop(*this)) {
-      payload.append((char*)&next_hop, sizeof(next_hop));
+      len += sizeof(next_hop);
     }
-    payload.append(data);
-    crc = utils::crc16(payload.data(), payload.size());
-    payload.append((char*)&crc, sizeof(crc));
-    ok = true;
-    return payload;
   }
+};
 
-  static message deserialize(const std::string& payload, bool& ok) {
-    message msg;
-    if (payload.size() < SizeMin || payload.size() > SizeMax) {
+/**
+ * non-owning message, parse and validate frame in place, data point to the frame buffer
+ */
+struct message_view : message_header {
+  data_view data;  // userdata or route_infos
+
+ public:
+  /**
+   * @param payload frame buffer, should be valid during the use of message_view
+   * @param reason set when failed, optional
+   */
+  template <typename Integrity = integrity::crc16>
+  static message_view parse(data_view payload, bool& ok, drop_reason* reason = nullptr) {
+    message_view msg;
+    ok = false;
+    if (payload.size() < frame_size<Integrity>::Min || payload.size() > frame_size<Integrity>::Max) {
       MESH_CORE_LOGE("size error");
-      ok = false;
+      set_reason(reason, drop_reason::size_error);
       return msg;
     }
-    char* p = (char*)payload.data();
+    const char* p = payload.data();
     const char* pend = payload.data() + payload.size();
-    msg.head = *(decltype(head)*)p;
-    p += sizeof(head);
+    read(p, msg.head);
     if (msg.head != MESH_CORE_MSG_MAGIC) {
       MESH_CORE_LOGE("head error");
-      ok = false;
+      set_reason(reason, drop_reason::head_error);
       return msg;
     }
-    msg.ver = *(decltype(ver)*)p;
-    p += sizeof(ver);
-    if (msg.ver != MESH_CORE_PROTO_VER) {
+    read(p, msg.ver);
+    if (msg.ver != proto::ProtoVer) {
       MESH_CORE_LOGE("version error");
-      ok = false;
+      set_reason(reason, drop_reason::version_error);
       return msg;
     }
-    msg.len = *(decltype(len)*)p;
-    p += sizeof(len);
+    read(p, msg.len);
     if (msg.len != payload.size() - SizeNotInLen) {
       MESH_CORE_LOGE("len error");
-      ok = false;
+      set_reason(reason, drop_reason::len_error);
       return msg;
     }
-    uint8_t type_ttl = *(uint8_t*)p;
-    msg.type = static_cast<message_type>(type_ttl >> 4);
-    msg.ttl = type_ttl & 0x0F;
-    p += sizeof(type_ttl);
-    msg.src = *(decltype(src)*)p;
-    p += sizeof(src);
-    msg.dst = *(decltype(dst)*)p;
-    p += sizeof(dst);
-    msg.seq = *(decltype(seq)*)p;
-    p += sizeof(seq);
-    msg.ts = *(decltype(ts)*)p;
-    p += sizeof(ts);
+    if (proto::Narrow) {
+      uint8_t type_ttl;
+      read(p, type_ttl);
+      msg.type = static_cast<message_type>(type_ttl >> 4);
+      msg.ttl = type_ttl & 0x0F;
+    } else {
+      read(p, msg.type);
+      read(p, msg.ttl);
+    }
+    read(p, msg.src);
+    read(p, msg.dst);
+    read(p, msg.seq);
+    read(p, msg.ts);
     if (has_next_hop(msg)) {
-      msg.next_hop = *(decltype(next_hop)*)p;
-      p += sizeof(next_hop);
+      if (pend - p < (ptrdiff_t)(sizeof(msg.next_hop) + Integrity::Size)) {
+        MESH_CORE_LOGE("len error");
+        set_reason(reason, drop_reason::len_error);
+        return msg;
+      }
+      read(p, msg.next_hop);
     }
 
-    // crc
-    msg.crc = *(uint16_t*)(pend - sizeof(crc));
-    uint16_t crc = utils::crc16(payload.data(), payload.size() - sizeof(crc));
+    // integrity check
+    const char* pcheck = pend - Integrity::Size;
+    msg.crc = read_check<Integrity>(pcheck);
+    uint32_t crc = Integrity::calc(payload.data(), payload.size() - Integrity::Size);
     if (msg.crc != crc) {
       MESH_CORE_LOGE("crc error");
-      ok = false;
+      set_reason(reason, drop_reason::crc_error);
       return msg;
     }
 
     // data
-    msg.data.assign(p, pend - p - sizeof(crc));
+    msg.data = data_view(p, pend - p - Integrity::Size);
     ok = true;
     return msg;
   }
 
-  void finalize() {
-    len = SizeMin + data.size() - SizeNotInLen;
-    if (has_next_hop(*this)) {
-      ++len;
-    }
+  static message_view from(const message& msg) {
+    message_view view;
+    static_cast<message_header&>(view) = msg;
+    view.data = msg.data;
+    return view;
   }
 
-  static bool has_next_hop(const message& msg) {
-    return msg.type == message_type::user_data || msg.type == message_type::route_debug_send || msg.type == message_type::route_debug_back;
+  message to_message() const {
+    message msg;
+    static_cast<message_header&>(msg) = *this;
+    msg.data.assign(data.data(), data.size());
+    return msg;
+  }
+
+ private:
+  static void set_reason(drop_reason* reason, drop_reason value) {
+    if (reason) *reason = value;
+  }
+
+  template <typename T>
+  static void read(const char*& p, T& value) {
+    memcpy(&value, p, sizeof(value));
+    p += sizeof(value);
+  }
+
+  template <typename Integrity>
+  static uint32_t read_check(const char* p) {
+    if (Integrity::Size == 2) {
+      uint16_t check;
+      read(p, check);
+      return check;
+    } else if (Integrity::Size == 4) {
+      uint32_t check;
+      read(p, check);
+      return check;
+    }
+    return 0;
   }
 };
 
+template <typename Integrity>
+inline message message::deserialize(data_view payload, bool& ok) {
+  auto view = message_view::parse<Integrity>(payload, ok);
+  if (!ok) {
+    return {};
+  }
+  return view.to_message();
+}
+
 }  // namespace mesh_core
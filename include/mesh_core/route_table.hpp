@@ -2,27 +2,31 @@
 
 // config
 #include "config.hpp"
+#include "detail/bitmap.hpp"
 #include "detail/copyable.hpp"
 #include "detail/log.h"
 #include "detail/noncopyable.hpp"
 #include "type.hpp"
 
 // std
+#include <cstddef>
 #include <cstdint>
-#include <functional>
-#include <list>
+#include <limits>
 
 namespace mesh_core {
 
 #pragma pack(1)
 struct route_msg : detail::copyable {
+  static const uint8_t MetricMask = 0x7F;
+  static const uint8_t FlagMpr = 0x80;  // for one hop neighbor: sender select it as multipoint relay
+
   addr_t dst{};
-  addr_t next_hop{};
-  uint8_t metric{};
+  addr_t next_hop{};  // sender's next hop, receiver treat it as unreachable if it is self(poison reverse)
+  uint8_t metric{};   // >= TTL_DEFAULT means unreachable, with flags
 };
 #pragma pack()
 
-enum class route_type {
+enum class route_type : uint8_t {
   DYNAMIC = 0,
   STATIC = 1,
 };
@@ -35,62 +39,382 @@ struct route_info : detail::copyable {
   lqs_t lqs{};
   timestamp_t expired{};
   route_type type{route_type::DYNAMIC};
+  iface_t iface{};  // egress interface, where the route is learned
 };
 
-class route_table : detail::noncopyable {
+/**
+ * direct indexed by dst address if `Size` covers all 8bit addresses, no heap allocation, O(1) find/add/rm
+ * otherwise dst is hashed into `Size` slots by linear probing, a slot keeps its dst
+ * a freed slot keeps its dst until it ends a probe chain, so probing stays short under churn
+ * changes of dst/next_hop/metric are tracked by dirty flags, for triggered route update
+ * withdrawn routes are held down for `hold_down_ms`, the slot keeps the old next_hop
+ * degraded next hops are remembered for `degrade_ms`, see `degrade`
+ */
+template <size_t Size = (sizeof(addr_t) == 1 ? size_t(256) : MESH_CORE_ROUTE_TABLE_SIZE), size_t DegradeNum = MESH_CORE_ROUTE_DEGRADE_NUM>
+class basic_route_table : detail::noncopyable {
  public:
-  route_info* find_node(addr_t dst) {
-    auto it = std::find_if(table_.begin(), table_.end(), [dst](const route_info& info) {
-      return info.dst == dst;
-    });
-    if (it == table_.cend()) {
-      return nullptr;
-    } else {
-      return &*it;
+  static const bool Direct = sizeof(addr_t) == 1 && Size == 256;
+  static const size_t Capacity = Size;
+  static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "route table size should be power of 2");
+  static_assert(DegradeNum > 0, "route degrade num error");
+
+  class iterator {
+   public:
+    iterator(basic_route_table* table, size_t index) : table_(table), index_(index) {}
+
+    route_info& operator*() const {
+      return table_->table_[index_];
+    }
+
+    route_info* operator->() const {
+      return &table_->table_[index_];
+    }
+
+    iterator& operator++() {
+      index_ = table_->used_.find_next(index_ + 1);
+      return *this;
+    }
+
+    bool operator==(const iterator& other) const {
+      return index_ == other.index_;
+    }
+
+    bool operator!=(const iterator& other) const {
+      return index_ != other.index_;
+    }
+
+   private:
+    basic_route_table* table_;
+    size_t index_;
+  };
+
+ public:
+  basic_route_table() {
+    if (Direct) {
+      for (size_t i = 0; i < Capacity; ++i) {
+        table_[i].dst = (addr_t)i;
+      }
     }
   }
 
-  void add(route_info info) {
-    auto old = find_node(info.dst);
-    if (old == nullptr) {
-      table_.push_back(info);
-    } else {
-      *old = info;
+  route_info* find_node(addr_t dst) {
+    size_t i = slot_of(dst);
+    return i < Capacity && used_.test(i) ? &table_[i] : nullptr;
+  }
+
+  const route_info* find_node(addr_t dst) const {
+    size_t i = slot_of(dst);
+    return i < Capacity && used_.test(i) ? &table_[i] : nullptr;
+  }
+
+  /**
+   * add or replace
+   * @return false if no free slot, only for 16bit address
+   */
+  bool add(route_info info) {
+    size_t i = slot_for(info.dst);
+    if (i == Capacity) {
+      MESH_CORE_LOGW("route table full: 0x%02X", info.dst);
+      return false;
+    }
+    auto& item = table_[i];
+    if (!used_.test(i)) {
+      used_.set(i);
+      held_.reset(i);
+      ++size_;
+      dirty_.set(i);
+    } else if (item.next_hop != info.next_hop || item.metric != info.metric) {
+      dirty_.set(i);
     }
+    item = info;
+    return true;
   }
 
   void rm(addr_t dst) {
-    table_.remove_if([dst](const route_info& i) {
-      return i.dst == dst;
-    });
+    size_t i = slot_of(dst);
+    if (i < Capacity && used_.test(i)) {
+      used_.reset(i);
+      --size_;
+      dirty_.set(i);
+    }
   }
 
-  const std::list<route_info>& get_table() {
-    return table_;
+  /**
+   * remove and hold down, during hold down only accept route from the old next hop
+   */
+  void withdraw(addr_t dst, timestamp_t ts) {
+    size_t i = slot_of(dst);
+    if (i == Capacity || !used_.test(i)) return;
+    rm(dst);
+    held_.set(i);
+    table_[i].expired = ts;  // slot is free, reuse as hold down start time
   }
 
-  void check_expired(timestamp_t ts) {
-    table_.remove_if([&ts](route_info& info) {
-      if (info.metric == 0) {  // skip self
-        return false;
+  /**
+   * @return true if route to dst from next_hop should be ignored
+   */
+  bool held_down(addr_t dst, addr_t next_hop, timestamp_t ts, uint32_t hold_down_ms = MESH_CORE_ROUTE_HOLD_DOWN_MS) {
+    size_t i = slot_of(dst);
+    if (i == Capacity || !held_.test(i)) return false;
+    if (ts - table_[i].expired >= hold_down_ms) {
+      held_.reset(i);
+      release(i);
+      return false;
+    }
+    return table_[i].next_hop != next_hop;
+  }
+
+  /**
+   * lowest lqs for dynamic routes via next_hop, so routes with the same metric from other neighbors are preferred.
+   * the next hop is remembered, routes learned from it keep the lowest lqs until `restore` or `degrade_ms`, see `degraded`
+   * @return changed route num
+   */
+  size_t degrade(addr_t next_hop, timestamp_t ts) {
+    degraded_hop* slot = nullptr;
+    for (auto& d : degraded_) {
+      if (d.active && d.next_hop == next_hop) {
+        slot = &d;
+        break;
       }
-      if (info.type == route_type::STATIC) {  // skip static route
+      if (!slot || (slot->active && (!d.active || ts - d.since > ts - slot->since))) slot = &d;
+    }
+    *slot = {next_hop, ts, true};
+
+    size_t changed = 0;
+    for (size_t i = used_.find_next(0); i < Capacity; i = used_.find_next(i + 1)) {
+      auto& item = table_[i];
+      if (item.next_hop != next_hop || item.metric == 0 || item.type != route_type::DYNAMIC) continue;
+      item.lqs = std::numeric_limits<lqs_t>::min();
+      ++changed;
+    }
+    return changed;
+  }
+
+  /**
+   * @return true if routes learned from next_hop should take the lowest lqs
+   */
+  bool degraded(addr_t next_hop, timestamp_t ts, uint32_t degrade_ms = MESH_CORE_ROUTE_DEGRADE_MS) {
+    for (auto& d : degraded_) {
+      if (!d.active || d.next_hop != next_hop) continue;
+      if (ts - d.since >= degrade_ms) {
+        d.active = false;
         return false;
       }
-      if (ts - info.expired > MESH_CORE_ROUTE_EXPIRED_MS) {
-        MESH_CORE_LOGD("route expired: 0x%02X", info.dst);
-        return true;
+      return true;
+    }
+    return false;
+  }
+
+  /**
+   * next_hop is heard again, its routes take the real lqs from the next route info
+   */
+  void restore(addr_t next_hop) {
+    for (auto& d : degraded_) {
+      if (d.next_hop == next_hop) d.active = false;
+    }
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  /**
+   * slots keeping a dst, including removed routes not yet advertised or released, bounds the probing of 16bit address
+   */
+  size_t assigned() const {
+    return Direct ? Capacity : assigned_.count();
+  }
+
+  void mark_dirty(addr_t dst) {
+    size_t i = slot_of(dst);
+    if (i < Capacity) dirty_.set(i);
+  }
+
+  bool has_dirty() const {
+    return dirty_.any();
+  }
+
+  /**
+   * @return slot index, Capacity if no more, the route may be removed
+   */
+  size_t next_dirty(size_t from) const {
+    return dirty_.find_next(from);
+  }
+
+  /**
+   * route of slot `i`, dst is valid even if the route is removed
+   */
+  const route_info& slot(size_t i) const {
+    return table_[i];
+  }
+
+  bool slot_used(size_t i) const {
+    return used_.test(i);
+  }
+
+  void clear_dirty(addr_t dst) {
+    size_t i = slot_of(dst);
+    if (i < Capacity) {
+      dirty_.reset(i);
+      release(i);
+    }
+  }
+
+  /**
+   * clear slot `i` once it is copied into a route update, changes made after that are kept for the next one
+   */
+  void clear_slot_dirty(size_t i) {
+    dirty_.reset(i);
+    release(i);
+  }
+
+  void clear_dirty() {
+    if (Direct) {
+      dirty_.clear();
+      return;
+    }
+    for (size_t i = dirty_.find_next(0); i < Capacity; i = dirty_.find_next(i + 1)) {
+      dirty_.reset(i);
+      release(i);
+    }
+  }
+
+  /**
+   * @param f void(const route_info&)
+   */
+  template <typename F>
+  void for_each(F&& f) const {
+    for (size_t i = used_.find_next(0); i < Capacity; i = used_.find_next(i + 1)) {
+      f(table_[i]);
+    }
+  }
+
+  iterator begin() {
+    return {this, used_.find_next(0)};
+  }
+
+  iterator end() {
+    return {this, Capacity};
+  }
+
+  /**
+   * @param expired_ms dynamic routes not refreshed in this time are withdrawn
+   * @param hold_down_ms withdrawn slots are released after this time
+   * @return removed route num
+   */
+  size_t check_expired(timestamp_t ts, uint32_t expired_ms = MESH_CORE_ROUTE_EXPIRED_MS, uint32_t hold_down_ms = MESH_CORE_ROUTE_HOLD_DOWN_MS) {
+    size_t removed = 0;
+    for (size_t i = used_.find_next(0); i < Capacity; i = used_.find_next(i + 1)) {
+      if (is_expired(table_[i], ts, expired_ms)) {
+        withdraw(table_[i].dst, ts);
+        ++removed;
+      }
+    }
+    // release slots after hold down
+    for (size_t i = held_.find_next(0); i < Capacity; i = held_.find_next(i + 1)) {
+      if (ts - table_[i].expired >= hold_down_ms) {
+        held_.reset(i);
+        release(i);
       }
-      if (info.metric >= MESH_CORE_TTL_DEFAULT) {
-        MESH_CORE_LOGD("metric expired");
-        return true;
+    }
+    return removed;
+  }
+
+ private:
+  static size_t hash(addr_t dst) {
+    return ((size_t)dst ^ ((size_t)dst >> 7)) & (Capacity - 1);
+  }
+
+  /**
+   * @return slot of dst, Capacity if not found
+   */
+  size_t slot_of(addr_t dst) const {
+    if (Direct) return dst;
+    for (size_t n = 0, i = hash(dst); n < Capacity; ++n, i = (i + 1) & (Capacity - 1)) {
+      if (!assigned_.test(i)) break;
+      if (table_[i].dst == dst) return i;
+    }
+    return Capacity;
+  }
+
+  /**
+   * find or assign a slot for dst, a slot is free if not used, held or dirty
+   * @return Capacity if full
+   */
+  size_t slot_for(addr_t dst) {
+    if (Direct) return dst;
+    size_t free = Capacity;
+    for (size_t n = 0, i = hash(dst); n < Capacity; ++n, i = (i + 1) & (Capacity - 1)) {
+      if (!assigned_.test(i)) {
+        if (free == Capacity) free = i;
+        break;
       }
+      if (table_[i].dst == dst) return i;
+      if (free == Capacity && is_free(i)) free = i;
+    }
+    if (free < Capacity) {
+      assigned_.set(free);
+      table_[free].dst = dst;
+    }
+    return free;
+  }
+
+  bool is_free(size_t i) const {
+    return !used_.test(i) && !held_.test(i) && !dirty_.test(i);
+  }
+
+  /**
+   * unassign free slot `i` and its free neighbors if they end a probe chain, no dst is probed past them
+   */
+  void release(size_t i) {
+    if (Direct || !is_free(i)) return;
+    size_t n = 0;
+    while (n < Capacity && assigned_.test(i) && is_free(i)) {
+      i = (i + 1) & (Capacity - 1);
+      ++n;
+    }
+    if (n < Capacity && assigned_.test(i)) return;  // chain goes on
+    i = (i - 1) & (Capacity - 1);
+    for (n = 0; n < Capacity && assigned_.test(i) && is_free(i); ++n, i = (i - 1) & (Capacity - 1)) {
+      assigned_.reset(i);
+    }
+  }
+
+ private:
+  static bool is_expired(const route_info& info, timestamp_t ts, uint32_t expired_ms) {
+    if (info.metric == 0) {  // skip self
+      return false;
+    }
+    if (info.type == route_type::STATIC) {  // skip static route
       return false;
-    });
+    }
+    if (ts - info.expired > expired_ms) {
+      MESH_CORE_LOGD("route expired: 0x%02X", info.dst);
+      return true;
+    }
+    if (info.metric >= MESH_CORE_TTL_DEFAULT) {
+      MESH_CORE_LOGD("metric expired");
+      return true;
+    }
+    return false;
   }
 
  private:
-  std::list<route_info> table_;
+  route_info table_[Capacity];
+  detail::bitmap<Capacity> used_;
+  detail::bitmap<Capacity> dirty_;
+  detail::bitmap<Capacity> held_;
+  detail::bitmap<Direct ? 1 : Capacity> assigned_;  // slot has a dst, probing stops at the first unassigned one
+  size_t size_{};
+
+  struct degraded_hop {
+    addr_t next_hop;
+    timestamp_t since;
+    bool active;
+  };
+  degraded_hop degraded_[DegradeNum]{};
 };
 
+using route_table = basic_route_table<>;
+
 }  // namespace mesh_core
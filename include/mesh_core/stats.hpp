@@ -0,0 +1,89 @@
+#pragma once
+
+// config
+#include "config.hpp"
+#include "type.hpp"
+
+// std
+#include <cstdint>
+
+namespace mesh_core {
+
+/**
+ * why a frame is dropped, also used to report parse errors
+ */
+enum class drop_reason : uint8_t {
+  // parse
+  size_error = 0,
+  head_error,
+  version_error,
+  len_error,
+  crc_error,
+  // filter
+  self_msg,
+  ttl_error,
+  duplicate,
+  // dispatch
+  unknown_type,
+  interceptor,
+  ttl_zero,
+  route_not_me,
+  not_relay,
+  no_route,
+  disable_route,
+  no_timer,
+  pool_full,
+  fragment_error,
+  reassembly_full,     // no free slot, or exceed MESH_CORE_REASSEMBLY_SIZE
+  reassembly_timeout,  // incomplete payload
+  reliable_error,
+  // transmit
+  tx_queue_full,
+  tx_expired,
+  airtime,
+
+  num,
+};
+
+/**
+ * per node counters, see `mesh::stats()`
+ * need Stats of Config(default MESH_CORE_ENABLE_STATS), otherwise the instance has no counters and counting code is dropped
+ */
+struct mesh_stats {
+  // message_type use 4 bits
+  static const int TypeNum = 16;
+
+  struct traffic {
+    uint32_t frames;
+    uint32_t bytes;
+  };
+
+  traffic tx[TypeNum];
+  traffic rx[TypeNum];  // valid frames, include duplicates
+
+  uint32_t forwards;
+  uint32_t rebroadcasts;
+  uint32_t rebroadcasts_suppressed;  // transmissions saved by storm suppression
+  uint32_t pool_evictions;           // pending rebroadcasts dropped for newer ones, see MESH_CORE_FRAME_POOL_POLICY
+  uint32_t retransmits;              // reliable messages sent again for no ack
+  uint32_t hop_retransmits;          // frames sent again for next hop not heard forwarding
+  uint32_t link_degrades;            // next hop not heard forwarding after retries
+  uint32_t drops[(int)drop_reason::num];
+
+  uint32_t route_adds;
+  uint32_t route_changes;
+  uint32_t route_expiries;
+  uint32_t route_withdrawals;  // by poison reverse or withdrawal from next hop
+
+  uint32_t serialize_fails;
+  uint64_t tx_airtime_us;  // by Impl::airtime_us or MESH_CORE_AIRTIME_BITRATE
+
+  uint32_t drop(drop_reason reason) const {
+    return drops[(int)reason];
+  }
+};
+
+}  // namespace mesh_core
+
+/// count into `stats` of the mesh instance, not called if Stats of its Config is false
+#define MESH_CORE_STATS(...) this->count_stats([&](mesh_stats& stats) { __VA_ARGS__; })
@@ -2,41 +2,124 @@
 
 // config
 #include "config.hpp"
+#include "data_view.hpp"
+#include "detail/inplace_function.hpp"
 
 // std
 #include <cstdint>
-#include <functional>
 #include <string>
+#include <type_traits>
 
 namespace mesh_core {
 
 #define MESH_CORE_UNUSED(x) (void)x
 
+/**
+ * wire widths of address and sequence, see MESH_CORE_ADDR_BITS and MESH_CORE_SEQ_BITS
+ *
+ * 1. 8bit address and sequence(narrow) packs type and ttl into one byte, ttl <= 15
+ * 2. otherwise type and ttl take one byte each, ttl <= 127(route metric)
+ * 3. the widths are carried in the high bits of the protocol version, nodes with different widths drop each other's frames
+ */
+template <typename Addr, typename Seq>
+struct proto_traits {
+  using addr_type = Addr;
+  using seq_type = Seq;
+  // uuid: {src|seq|ts & 0xFFFF}
+  using uuid_type = typename std::conditional<sizeof(Addr) + sizeof(Seq) + 2 <= 4, uint32_t, uint64_t>::type;
+
+  static const bool Narrow = sizeof(Addr) == 1 && sizeof(Seq) == 1;
+  static const uint8_t ProtoVer = MESH_CORE_PROTO_VER | (sizeof(Addr) == 2 ? 0x40 : 0) | (sizeof(Seq) == 2 ? 0x80 : 0);
+  static const uint8_t TtlMax = Narrow ? 0x0F : 0x7F;
+
+  static_assert(sizeof(Addr) == 1 || sizeof(Addr) == 2, "address should be 8 or 16 bits");
+  static_assert(sizeof(Seq) == 1 || sizeof(Seq) == 2, "sequence should be 8 or 16 bits");
+  static_assert(MESH_CORE_PROTO_VER < 0x40, "high bits of proto ver are for widths");
+};
+
+#if MESH_CORE_ADDR_BITS == 8
+using proto_addr_t = uint8_t;
+#elif MESH_CORE_ADDR_BITS == 16
+using proto_addr_t = uint16_t;
+#else
+#error "MESH_CORE_ADDR_BITS should be 8 or 16"
+#endif
+
+#if MESH_CORE_SEQ_BITS == 8
+using proto_seq_t = uint8_t;
+#elif MESH_CORE_SEQ_BITS == 16
+using proto_seq_t = uint16_t;
+#else
+#error "MESH_CORE_SEQ_BITS should be 8 or 16"
+#endif
+
+using proto = proto_traits<proto_addr_t, proto_seq_t>;
+
 /// type define
-using addr_t = uint8_t;
-using seq_t = uint8_t;
+using addr_t = proto::addr_type;
+using seq_t = proto::seq_type;
 using ttl_t = uint8_t;
 using data_t = std::string;
 using timestamp_t = uint32_t;
-using msg_uuid_t = uint32_t;
+using msg_uuid_t = proto::uuid_type;
 using lqs_t = int8_t;  // link quality score
+using iface_t = uint8_t;  // interface index of Impl
 
 /// assert
 static_assert(std::is_trivial<addr_t>::value, "");
 static_assert(std::is_trivial<seq_t>::value, "");
 static_assert(std::is_trivial<ttl_t>::value, "");
 static_assert(std::is_trivial<msg_uuid_t>::value, "");
-static_assert(sizeof(msg_uuid_t) >= sizeof(addr_t) + sizeof(seq_t), "msg_uuid: [src, seq, ts]");
+static_assert(sizeof(msg_uuid_t) >= sizeof(addr_t) + sizeof(seq_t) + 2, "msg_uuid: [src, seq, ts]");
+static_assert(MESH_CORE_TTL_DEFAULT <= proto::TtlMax, "ttl exceed the header field");
+
+/// handle, move-only, captures should fit MESH_CORE_FUNCTION_CAPACITY
+using recv_handle_t = detail::inplace_function<void(data_view, mesh_core::lqs_t)>;
+using on_recv_handle_t = detail::inplace_function<void(addr_t, data_view)>;
+using on_recv_debug_handle_t = detail::inplace_function<void(addr_t, data_view)>;
+using time_sync_handle_t = detail::inplace_function<void(timestamp_t)>;
+using tx_done_handle_t = detail::inplace_function<void()>;
+using send_done_handle_t = detail::inplace_function<void(bool)>;
+
+/// a fragment of large payload, see mesh::on_recv_fragment
+struct fragment_info {
+  uint8_t id;       // transfer id, unique per source
+  uint16_t index;   // may arrive out of order
+  uint16_t count;   // fragments of the payload
+  uint32_t offset;  // of the data in the payload
+  bool complete;    // all fragments received
+};
+
+using on_recv_fragment_handle_t = detail::inplace_function<void(addr_t, const fragment_info&, data_view)>;
+
+/// how broadcast messages are relayed
+enum class relay_mode : uint8_t {
+  flooding = 0,  // every node rebroadcast
+  counter = 1,   // cancel rebroadcast after heard enough copies, see MESH_CORE_REBROADCAST_*
+  mpr = 2,       // only multipoint relays of the last hop rebroadcast, need Mpr of Config,
+                 // no redundancy: a node covered by one relay misses the flood if that frame is lost,
+                 // prefer counter on lossy dense links
+};
+
+/// an interface of Impl, see mesh::set_interface
+struct interface_config {
+  uint8_t cost = 1;     // added to the metric of routes learned on it, >= 1
+  bool flood = true;    // floods(broadcast, sync time) are sent on it
+  bool reflood = true;  // floods received on it are sent back on it, false for a bus where all nodes hear each other
+};
+
+/// transmit order when Impl supports tx done, smaller first
+enum class tx_priority : uint8_t {
+  routing = 0,
+  time_sync = 1,
+  unicast = 2,
+  flood = 3,
 
-/// handle
-using recv_handle_t = std::function<void(std::string, mesh_core::lqs_t)>;
-using on_recv_handle_t = std::function<void(addr_t, data_t)>;
-using on_recv_debug_handle_t = std::function<void(addr_t, data_t)>;
-using time_sync_handle_t = std::function<void(timestamp_t)>;
+  num,
+};
 
 /// default value
 const ttl_t TTL_DEFAULT = MESH_CORE_TTL_DEFAULT;
-const int LRU_RECORD_SIZE = MESH_CORE_LRU_RECORD_SIZE;
 const int DELAY_MIN = MESH_CORE_DELAY_MS_MIN;
 const int DELAY_MAX = MESH_CORE_DELAY_MS_MAX;
 
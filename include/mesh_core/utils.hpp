@@ -4,7 +4,15 @@
 #include "config.hpp"
 
 // std
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
 
 namespace mesh_core {
 namespace utils {
@@ -18,14 +26,63 @@ inline uint32_t time_based_random(uint32_t timestamp, uint32_t l, uint32_t r) {
   return l + (hash % range);
 }
 
+namespace detail {
+
+struct crc16_tables {
+  uint16_t t[8][256];
+};
+
+constexpr crc16_tables make_crc16_tables() {
+  crc16_tables tables{};
+  for (int n = 0; n < 256; ++n) {
+    uint16_t crc = (uint16_t)(n << 8);
+    for (int i = 0; i < 8; ++i) {
+      crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+    tables.t[0][n] = crc;
+  }
+  for (int k = 1; k < 8; ++k) {
+    for (int n = 0; n < 256; ++n) {
+      uint16_t prev = tables.t[k - 1][n];
+      tables.t[k][n] = (uint16_t)((prev << 8) ^ tables.t[0][prev >> 8]);
+    }
+  }
+  return tables;
+}
+
+inline const crc16_tables& get_crc16_tables() {
+  static constexpr crc16_tables tables = make_crc16_tables();
+  return tables;
+}
+
+struct crc32c_table {
+  uint32_t t[256];
+};
+
+constexpr crc32c_table make_crc32c_table() {
+  crc32c_table table{};
+  for (uint32_t n = 0; n < 256; ++n) {
+    uint32_t crc = n;
+    for (int i = 0; i < 8; ++i) {
+      crc = (crc & 1) ? (crc >> 1) ^ 0x82F63B78 : (crc >> 1);
+    }
+    table.t[n] = crc;
+  }
+  return table;
+}
+
+inline const crc32c_table& get_crc32c_table() {
+  static constexpr crc32c_table table = make_crc32c_table();
+  return table;
+}
+
+}  // namespace detail
+
 /**
- * CRC-16/CCITT-FALSE
- * @param data
- * @param size
- * @return
+ * CRC-16/CCITT-FALSE, 4bit table, 32 bytes rom
  */
-inline uint16_t crc16(const void* data, size_t size) {
-  auto d = (uint8_t*)data;
+inline uint16_t crc16_nibble(const void* data, size_t size) {
+  auto d = (const uint8_t*)data;
   uint16_t crc = 0xFFFF;
   static const uint16_t crc_table[16] = {0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
                                          0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF};
@@ -37,5 +94,118 @@ inline uint16_t crc16(const void* data, size_t size) {
   return crc & 0xFFFF;
 }
 
+/**
+ * CRC-16/CCITT-FALSE, 8bit table, 512 bytes rom
+ */
+inline uint16_t crc16_byte(const void* data, size_t size) {
+  auto d = (const uint8_t*)data;
+  const auto& t = detail::get_crc16_tables().t[0];
+  uint16_t crc = 0xFFFF;
+  while (size--) {
+    crc = (uint16_t)((crc << 8) ^ t[(crc >> 8) ^ *d++]);
+  }
+  return crc;
+}
+
+/**
+ * CRC-16/CCITT-FALSE, slice-by-8, 4K bytes rom
+ */
+inline uint16_t crc16_slice8(const void* data, size_t size) {
+  auto d = (const uint8_t*)data;
+  const auto& t = detail::get_crc16_tables().t;
+  uint16_t crc = 0xFFFF;
+  while (size >= 8) {
+    crc = t[7][d[0] ^ (crc >> 8)] ^ t[6][d[1] ^ (crc & 0xFF)] ^ t[5][d[2]] ^ t[4][d[3]] ^ t[3][d[4]] ^ t[2][d[5]] ^ t[1][d[6]] ^ t[0][d[7]];
+    d += 8;
+    size -= 8;
+  }
+  while (size--) {
+    crc = (uint16_t)((crc << 8) ^ t[0][(crc >> 8) ^ *d++]);
+  }
+  return crc;
+}
+
+/**
+ * CRC-16/CCITT-FALSE, implementation selected by `MESH_CORE_CRC16_IMPL`
+ * @param data
+ * @param size
+ * @return
+ */
+inline uint16_t crc16(const void* data, size_t size) {
+#if MESH_CORE_CRC16_IMPL == 0
+  return crc16_nibble(data, size);
+#elif MESH_CORE_CRC16_IMPL == 1
+  return crc16_byte(data, size);
+#else
+  return crc16_slice8(data, size);
+#endif
+}
+
+/**
+ * CRC-32C(Castagnoli), 8bit table, 1K bytes rom
+ */
+inline uint32_t crc32c_sw(const void* data, size_t size) {
+  auto d = (const uint8_t*)data;
+  const auto& t = detail::get_crc32c_table().t;
+  uint32_t crc = 0xFFFFFFFF;
+  while (size--) {
+    crc = (crc >> 8) ^ t[(crc ^ *d++) & 0xFF];
+  }
+  return crc ^ 0xFFFFFFFF;
+}
+
+#if defined(__SSE4_2__) || defined(__ARM_FEATURE_CRC32)
+#define MESH_CORE_CRC32C_HW
+
+/**
+ * CRC-32C(Castagnoli), by SSE4.2 or ARMv8 crc32 instructions
+ */
+inline uint32_t crc32c_hw(const void* data, size_t size) {
+  auto d = (const uint8_t*)data;
+  uint32_t crc = 0xFFFFFFFF;
+#if defined(__SSE4_2__) && (defined(__x86_64__) || defined(_M_X64))
+  uint64_t crc64 = crc;
+  while (size >= 8) {
+    uint64_t v;
+    memcpy(&v, d, sizeof(v));
+    crc64 = _mm_crc32_u64(crc64, v);
+    d += 8;
+    size -= 8;
+  }
+  crc = (uint32_t)crc64;
+  while (size--) {
+    crc = _mm_crc32_u8(crc, *d++);
+  }
+#elif defined(__SSE4_2__)
+  while (size--) {
+    crc = _mm_crc32_u8(crc, *d++);
+  }
+#else
+  while (size >= 8) {
+    uint64_t v;
+    memcpy(&v, d, sizeof(v));
+    crc = __crc32cd(crc, v);
+    d += 8;
+    size -= 8;
+  }
+  while (size--) {
+    crc = __crc32cb(crc, *d++);
+  }
+#endif
+  return crc ^ 0xFFFFFFFF;
+}
+#endif
+
+/**
+ * CRC-32C(Castagnoli), use hardware instructions if available
+ */
+inline uint32_t crc32c(const void* data, size_t size) {
+#ifdef MESH_CORE_CRC32C_HW
+  return crc32c_hw(data, size);
+#else
+  return crc32c_sw(data, size);
+#endif
+}
+
 }  // namespace utils
 }  // namespace mesh_core
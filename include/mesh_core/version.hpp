@@ -8,4 +8,4 @@
 #define MESH_CORE_VERSION MESH_CORE_TO_VERSION(MESH_CORE_VER_MAJOR, MESH_CORE_VER_MINOR, MESH_CORE_VER_PATCH)
 
 #define MESH_CORE_MSG_MAGIC 0x3C
-#define MESH_CORE_PROTO_VER 1
+#define MESH_CORE_PROTO_VER 3
@@ -0,0 +1,425 @@
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define BENCH_HAS_RDTSC
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+#include "mesh_core.hpp"
+#include "mesh_core/concurrent_mesh.hpp"
+#include "mesh_core/mesh_host.hpp"
+
+/**
+ * count heap allocations, all operator new variants end up here, from any thread
+ */
+static std::atomic<uint64_t> g_alloc_count{0};
+
+void* operator new(size_t size) {
+  g_alloc_count.fetch_add(1, std::memory_order_relaxed);
+  void* p = malloc(size ? size : 1);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  free(p);
+}
+
+/**
+ * output one json object per line, for compare between releases
+ */
+namespace bench {
+
+static volatile uint32_t sink;
+
+static uint64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static uint64_t now_cycles() {
+#ifdef BENCH_HAS_RDTSC
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+/**
+ * @param bytes bytes processed per op, 0 for not applicable
+ * @param op return value will be consumed to avoid optimized out
+ */
+template <typename Op>
+static void run(const char* name, size_t bytes, Op&& op) {
+  const uint64_t target_ns = 50 * 1000 * 1000;
+  uint64_t iterations = 1;
+  for (;;) {
+    uint64_t start = now_ns();
+    for (uint64_t i = 0; i < iterations; ++i) {
+      sink = sink + (uint32_t)op();
+    }
+    if (now_ns() - start > target_ns / 10) break;
+    iterations *= 2;
+  }
+  iterations *= 10;
+
+  uint64_t start_allocs = g_alloc_count.load(std::memory_order_relaxed);
+  uint64_t start_ns = now_ns();
+  uint64_t start_cycles = now_cycles();
+  for (uint64_t i = 0; i < iterations; ++i) {
+    sink = sink + (uint32_t)op();
+  }
+  uint64_t cycles = now_cycles() - start_cycles;
+  uint64_t ns = now_ns() - start_ns;
+  uint64_t allocs = g_alloc_count.load(std::memory_order_relaxed) - start_allocs;
+
+  double ns_per_op = (double)ns / (double)iterations;
+  double cycles_per_op = (double)cycles / (double)iterations;
+  printf("{\"name\":\"%s\",\"iterations\":%llu,\"ns_per_op\":%.2f", name, (unsigned long long)iterations, ns_per_op);
+  printf(",\"allocs_per_op\":%.2f", (double)allocs / (double)iterations);
+  if (cycles) {
+    printf(",\"cycles_per_op\":%.2f", cycles_per_op);
+  }
+  if (bytes) {
+    printf(",\"bytes\":%zu,\"bytes_per_ns\":%.3f", bytes, (double)bytes / ns_per_op);
+    if (cycles) {
+      printf(",\"bytes_per_cycle\":%.3f", (double)bytes / cycles_per_op);
+    }
+  }
+  printf("}\n");
+}
+
+}  // namespace bench
+
+static void bench_crc() {
+  static uint8_t data[mesh_core::message::SizeMax];
+  for (size_t i = 0; i < sizeof(data); ++i) {
+    data[i] = (uint8_t)(i * 7 + 3);
+  }
+  char name[64];
+  for (size_t size : {16, 64, (int)sizeof(data)}) {
+    snprintf(name, sizeof(name), "crc16_nibble/%zu", size);
+    bench::run(name, size, [&] {
+      return mesh_core::utils::crc16_nibble(data, size);
+    });
+    snprintf(name, sizeof(name), "crc16_byte/%zu", size);
+    bench::run(name, size, [&] {
+      return mesh_core::utils::crc16_byte(data, size);
+    });
+    snprintf(name, sizeof(name), "crc16_slice8/%zu", size);
+    bench::run(name, size, [&] {
+      return mesh_core::utils::crc16_slice8(data, size);
+    });
+    snprintf(name, sizeof(name), "crc32c_sw/%zu", size);
+    bench::run(name, size, [&] {
+      return mesh_core::utils::crc32c_sw(data, size);
+    });
+#ifdef MESH_CORE_CRC32C_HW
+    snprintf(name, sizeof(name), "crc32c_hw/%zu", size);
+    bench::run(name, size, [&] {
+      return mesh_core::utils::crc32c_hw(data, size);
+    });
+#endif
+  }
+}
+
+static std::string make_frame(mesh_core::message_type type, mesh_core::addr_t src, mesh_core::addr_t dst, mesh_core::seq_t seq,
+                              mesh_core::data_view data, mesh_core::addr_t next_hop = 0) {
+  mesh_core::message m;
+  m.type = type;
+  m.src = src;
+  m.dst = dst;
+  m.seq = seq;
+  m.ttl = mesh_core::TTL_DEFAULT;
+  m.ts = 1000;
+  m.next_hop = next_hop;
+  m.data = data;
+  bool ok;
+  return m.serialize(ok);
+}
+
+static void bench_message() {
+  std::string data(64, 'x');
+  mesh_core::message m;
+  m.type = mesh_core::message_type::user_data;
+  m.src = 1;
+  m.dst = 2;
+  m.next_hop = 2;
+  m.data = data;
+
+  bench::run("message_serialize/64", data.size(), [&] {
+    bool ok;
+    return m.serialize(ok).size();
+  });
+
+  uint8_t buffer[mesh_core::message::SizeMax];
+  bench::run("message_serialize_into/64", data.size(), [&] {
+    return m.serialize_into(buffer, sizeof(buffer));
+  });
+
+  bool ok;
+  auto payload = m.serialize(ok);
+  bench::run("message_deserialize/64", data.size(), [&] {
+    mesh_core::message msg;
+    msg.deserialize(payload, ok);
+    return msg.data.size();
+  });
+
+  bench::run("message_view_parse/64", data.size(), [&] {
+    return mesh_core::message_view::parse(payload, ok).data.size();
+  });
+}
+
+static void bench_dup_filter() {
+  mesh_core::detail::dup_filter<> filter;
+  // warm: all sources have records
+  for (int src = 0; src < 256; ++src) {
+    filter.check_and_put((mesh_core::addr_t)src, 0, 1000);
+  }
+
+  uint32_t i = 0;
+  bench::run("dup_filter_new", 0, [&] {
+    ++i;
+    return filter.check_and_put((mesh_core::addr_t)i, (mesh_core::seq_t)(i >> 8), 1000);
+  });
+  bench::run("dup_filter_dup", 0, [&] {
+    ++i;
+    return filter.check_and_put((mesh_core::addr_t)i, (mesh_core::seq_t)((i >> 8) - 1), 1000);
+  });
+}
+
+static void bench_route_table() {
+  char name[64];
+  for (int num : {16, 64, 255}) {
+    mesh_core::route_table table;
+    for (int dst = 0; dst < num; ++dst) {
+      mesh_core::route_info info;
+      info.dst = (mesh_core::addr_t)dst;
+      info.next_hop = 1;
+      info.metric = 1;
+      table.add(info);
+    }
+    uint32_t i = 0;
+    snprintf(name, sizeof(name), "route_table_find_node/%d", num);
+    bench::run(name, 0, [&] {
+      return table.find_node((mesh_core::addr_t)(i++ % num)) != nullptr;
+    });
+  }
+}
+
+namespace {
+
+struct bench_impl {
+  void broadcast(mesh_core::data_view data) {
+    tx_bytes += data.size();
+  }
+  void set_recv_handle(mesh_core::recv_handle_t handle) {
+    recv_handle = std::move(handle);
+  }
+  mesh_core::timestamp_t get_timestamp_ms() {
+    return now;
+  }
+
+  mesh_core::recv_handle_t recv_handle;
+  mesh_core::timestamp_t now = 1000;
+  size_t tx_bytes = 0;
+};
+
+}  // namespace
+
+/**
+ * feed frames to the recv handle, seq increase for each frame to pass the dup filter.
+ * no run_delay, clock steps MESH_CORE_DELAY_MS_MAX and mesh is polled for each frame, so the rebroadcast of each frame is sent in the loop
+ */
+static void bench_dispatch(const char* name, mesh_core::message_type type, mesh_core::addr_t src, mesh_core::addr_t dst, mesh_core::data_view data,
+                           mesh_core::addr_t next_hop = 0) {
+  static bench_impl impl;
+  static mesh_core::mesh<bench_impl>* mesh = [] {
+    auto m = new mesh_core::mesh<bench_impl>(&impl);
+    m->init(0);
+    m->add_static_route(0x10, 0x11);
+    m->on_recv([](mesh_core::addr_t, mesh_core::data_view data) {
+      bench::sink = bench::sink + (uint32_t)data.size();
+    });
+    return m;
+  }();
+
+  std::vector<std::string> frames;
+  for (int seq = 0; seq < 256; ++seq) {
+    frames.push_back(make_frame(type, src, dst, (mesh_core::seq_t)seq, data, next_hop));
+  }
+  uint32_t i = 0;
+  bench::run(name, frames[0].size(), [&] {
+    impl.recv_handle(frames[i++ % frames.size()], 0);
+    impl.now += MESH_CORE_DELAY_MS_MAX;
+    mesh->poll();
+    return impl.tx_bytes;
+  });
+}
+
+/**
+ * construct, init and destroy a mesh in place, allocs_per_op is what init allocates
+ */
+static void bench_mesh_init() {
+  using mesh_t = mesh_core::mesh<bench_impl>;
+  static bench_impl impl;
+  static typename std::aligned_storage<sizeof(mesh_t), alignof(mesh_t)>::type storage;
+  bench::run("mesh_init", 0, [&] {
+    auto m = new (&storage) mesh_t(&impl);
+    m->init(0);
+    m->~mesh_t();
+    return impl.tx_bytes;
+  });
+}
+
+static void bench_mesh() {
+  using mesh_core::message_type;
+  // full advertisement from a neighbor
+  std::vector<mesh_core::route_msg> rms(mesh_core::message::DataSizeMax / sizeof(mesh_core::route_msg));
+  for (size_t i = 0; i < rms.size(); ++i) {
+    rms[i].dst = (mesh_core::addr_t)(0x80 + i);
+    rms[i].next_hop = 0x01;
+    rms[i].metric = (uint8_t)(i % 4);
+  }
+  mesh_core::data_view routes(rms.data(), rms.size() * sizeof(mesh_core::route_msg));
+  std::string data(64, 'x');
+
+  bench_dispatch("dispatch_route_info/full", message_type::route_info, 0x01, 0, routes);
+  bench_dispatch("dispatch/route_info_and_request", message_type::route_info_and_request, 0x02, 0, routes);
+  bench_dispatch("dispatch/user_data_recv", message_type::user_data, 0x03, 0x00, data, 0x00);
+  bench_dispatch("dispatch/user_data_forward", message_type::user_data, 0x04, 0x10, data, 0x00);
+  bench_dispatch("dispatch/broadcast", message_type::broadcast, 0x05, 0, data);
+  bench_dispatch("dispatch/sync_time", message_type::sync_time, 0x06, 0, {});
+  bench_dispatch("dispatch/route_debug_send", message_type::route_debug_send, 0x07, 0x00, "7", 0x00);
+  bench_dispatch("dispatch/route_debug_back", message_type::route_debug_back, 0x08, 0x00, "8", 0x00);
+}
+
+/**
+ * producers send through concurrent_mesh while this thread drains and polls the mesh, spin on backpressure.
+ * ns_per_op is wall time per command from the first send to the last one run
+ */
+static void bench_concurrent() {
+  using concurrent_t = mesh_core::concurrent_mesh<mesh_core::mesh<bench_impl>>;
+  const uint32_t total = 1 << 18;
+  std::string data(32, 'x');
+  char name[64];
+  for (int threads : {1, 2, 4, 8}) {
+    bench_impl impl;
+    mesh_core::mesh<bench_impl> mesh(&impl);
+    mesh.init(0);
+    mesh.add_static_route(0x10, 0x11);
+    concurrent_t cm(mesh, [] {});
+    uint32_t per_thread = total / threads;
+    std::atomic<bool> go{false};
+    std::atomic<uint64_t> retries{0};
+    std::vector<std::thread> producers;
+    for (int t = 0; t < threads; ++t) {
+      producers.emplace_back([&] {
+        while (!go.load(std::memory_order_acquire)) std::this_thread::yield();
+        uint64_t spins = 0;
+        for (uint32_t i = 0; i < per_thread; ++i) {
+          while (!cm.send(0x10, data)) {
+            ++spins;
+            std::this_thread::yield();
+          }
+        }
+        retries.fetch_add(spins, std::memory_order_relaxed);
+      });
+    }
+
+    uint32_t done = 0;
+    uint64_t start_allocs = g_alloc_count.load(std::memory_order_relaxed);
+    uint64_t start_ns = bench::now_ns();
+    go.store(true, std::memory_order_release);
+    while (done < per_thread * threads) {
+      size_t n = cm.drain();
+      done += (uint32_t)n;
+      impl.now += 1;
+      mesh.poll();
+      if (n == 0) std::this_thread::yield();
+    }
+    uint64_t ns = bench::now_ns() - start_ns;
+    uint64_t allocs = g_alloc_count.load(std::memory_order_relaxed) - start_allocs;
+    for (auto& p : producers) p.join();
+
+    snprintf(name, sizeof(name), "concurrent_send/%d", threads);
+    printf("{\"name\":\"%s\",\"iterations\":%u,\"ns_per_op\":%.2f", name, done, (double)ns / done);
+    printf(",\"allocs_per_op\":%.2f,\"retries_per_op\":%.2f}\n", (double)allocs / done, (double)retries.load() / done);
+  }
+}
+
+/**
+ * a ring of nodes on mesh_host, in each round every node sends unicast to the next one, the frame is delivered to both neighbours.
+ * contiguous nodes on one shard, only the edges cross shards. ns_per_op is wall time per frame delivered
+ */
+static void bench_host() {
+  using host_t = mesh_core::mesh_host<>;
+  const int nodes = 64;
+  const int rounds = 2000;
+  std::string data(32, 'x');
+  char name[64];
+  for (int threads : {1, 2, 4, 8}) {
+    host_t host(threads);
+    for (int i = 0; i < nodes; ++i) {
+      host.add_node((mesh_core::addr_t)(i + 1), i * threads / nodes);
+    }
+    for (int i = 0; i < nodes; ++i) {
+      host.link((mesh_core::addr_t)(i + 1), (mesh_core::addr_t)((i + 1) % nodes + 1));
+    }
+    host.start();
+    // let the first route updates settle
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    uint64_t start_frames = host.frames();
+    uint64_t start_ns = bench::now_ns();
+    uint64_t expected = start_frames;
+    for (int r = 0; r < rounds; ++r) {
+      for (int i = 0; i < nodes; ++i) {
+        auto next = (mesh_core::addr_t)((i + 1) % nodes + 1);
+        host.post((mesh_core::addr_t)(i + 1), [&data, next](host_t::mesh_t& m) {
+          m.send(next, data);
+        });
+      }
+      // inboxes never overflow
+      expected += nodes * 2;
+      while (host.frames() < expected) {
+        std::this_thread::yield();
+      }
+    }
+    uint64_t ns = bench::now_ns() - start_ns;
+    uint64_t frames = host.frames() - start_frames;
+    host.stop();
+
+    snprintf(name, sizeof(name), "host_ring/%d", threads);
+    printf("{\"name\":\"%s\",\"iterations\":%llu,\"ns_per_op\":%.2f,\"drops\":%llu}\n", name, (unsigned long long)frames,
+           (double)ns / frames, (unsigned long long)host.drops());
+  }
+}
+
+int main() {
+  bench_crc();
+  bench_message();
+  bench_dup_filter();
+  bench_route_table();
+  bench_mesh_init();
+  bench_mesh();
+  bench_concurrent();
+  bench_host();
+  return 0;
+}
@@ -0,0 +1,374 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "mesh_core.hpp"
+
+/**
+ * deterministic discrete-event network simulator
+ *
+ * 1. virtual clock, events run in time order, far faster than real time
+ * 2. configurable topology, per-link loss/latency/lqs model
+ * 3. same seed gives the same result
+ *
+ * usage:
+ *   sim::network net(seed);
+ *   net.make_line(10);
+ *   std::vector<std::unique_ptr<mesh_core::mesh<sim::node_impl>>> meshes;
+ *   for (int i = 0; i < net.node_num(); ++i) {
+ *     meshes.emplace_back(new mesh_core::mesh<sim::node_impl>(net.impl(i)));
+ *     meshes.back()->init(i);
+ *   }
+ *   net.run_for(60 * 1000);
+ */
+namespace sim {
+
+class network;
+
+struct link_model {
+  double loss = 0;          // drop probability, [0, 1]
+  uint32_t latency_ms = 1;  // fixed latency
+  uint32_t jitter_ms = 0;   // random extra latency, [0, jitter_ms]
+  mesh_core::lqs_t lqs = 0;
+};
+
+/**
+ * Impl for mesh_core::mesh, all nodes share the virtual clock of network
+ */
+class node_impl {
+ public:
+  node_impl(network* net, int id) : net_(net), id_(id) {}
+
+  void broadcast(mesh_core::data_view data);
+
+  void set_recv_handle(mesh_core::recv_handle_t handle) {
+    recv_handle_ = std::move(handle);
+  }
+
+  mesh_core::timestamp_t get_timestamp_ms() const;
+
+  void run_delay(std::function<void()> handle, uint32_t ms);
+
+  uint32_t airtime_us(size_t bytes) const;
+
+  int id() const {
+    return id_;
+  }
+
+ private:
+  friend class network;
+  network* net_;
+  int id_;
+  mesh_core::recv_handle_t recv_handle_;
+};
+
+class network {
+ public:
+  struct edge {
+    int to;
+    link_model model;
+  };
+
+  struct counter {
+    uint64_t tx_frames = 0;
+    uint64_t tx_bytes = 0;
+    uint64_t rx_frames = 0;
+    uint64_t lost_frames = 0;
+    uint64_t tx_type_frames[16] = {};  // by message_type, invalid frames are not counted
+    uint64_t tx_airtime_us = 0;        // need set_bitrate
+  };
+
+ public:
+  explicit network(uint32_t seed = 0, mesh_core::timestamp_t start_ms = 1000) : rng_(seed), now_(start_ms) {}
+
+  network(const network&) = delete;
+  network& operator=(const network&) = delete;
+
+  int add_node() {
+    int id = (int)nodes_.size();
+    nodes_.emplace_back(new node_impl(this, id));
+    links_.emplace_back();
+    node_counters_.emplace_back();
+    up_.push_back(true);
+    return id;
+  }
+
+  int node_num() const {
+    return (int)nodes_.size();
+  }
+
+  node_impl* impl(int id) {
+    return nodes_[id].get();
+  }
+
+  void link(int a, int b, link_model model = {}, bool bidirectional = true) {
+    set_edge(a, b, model);
+    if (bidirectional) {
+      set_edge(b, a, model);
+    }
+  }
+
+  void unlink(int a, int b, bool bidirectional = true) {
+    rm_edge(a, b);
+    if (bidirectional) {
+      rm_edge(b, a);
+    }
+  }
+
+  bool linked(int a, int b) const {
+    for (const auto& e : links_[a]) {
+      if (e.to == b) return true;
+    }
+    return false;
+  }
+
+  const std::vector<edge>& neighbors(int id) const {
+    return links_[id];
+  }
+
+  /**
+   * node down: stop sending and receiving, timers still run
+   */
+  void set_up(int id, bool up) {
+    up_[id] = up;
+  }
+
+  /**
+   * drop chosen frames on top of the link loss, return true to drop the frame from `from` to `to`
+   */
+  void set_drop_filter(std::function<bool(int from, int to, mesh_core::data_view frame)> filter) {
+    drop_filter_ = std::move(filter);
+  }
+
+  /// topology helpers
+
+  void make_line(int n, link_model model = {}) {
+    int base = add_nodes(n);
+    for (int i = 1; i < n; ++i) {
+      link(base + i - 1, base + i, model);
+    }
+  }
+
+  /**
+   * w * h grid, link nodes with euclidean distance <= radius
+   */
+  void make_grid(int w, int h, double radius = 1, link_model model = {}) {
+    int base = add_nodes(w * h);
+    for (int a = 0; a < w * h; ++a) {
+      for (int b = a + 1; b < w * h; ++b) {
+        double dx = a % w - b % w;
+        double dy = a / w - b / w;
+        if (std::sqrt(dx * dx + dy * dy) <= radius) {
+          link(base + a, base + b, model);
+        }
+      }
+    }
+  }
+
+  /**
+   * random nodes in unit square, link nodes with distance <= radius
+   */
+  void make_random_geometric(int n, double radius, link_model model = {}) {
+    int base = add_nodes(n);
+    std::uniform_real_distribution<double> dist(0, 1);
+    std::vector<std::pair<double, double>> pos(n);
+    for (auto& p : pos) {
+      p.first = dist(rng_);
+      p.second = dist(rng_);
+    }
+    for (int a = 0; a < n; ++a) {
+      for (int b = a + 1; b < n; ++b) {
+        double dx = pos[a].first - pos[b].first;
+        double dy = pos[a].second - pos[b].second;
+        if (std::sqrt(dx * dx + dy * dy) <= radius) {
+          link(base + a, base + b, model);
+        }
+      }
+    }
+  }
+
+  /**
+   * radio bitrate for airtime of nodes, 0 for no airtime
+   */
+  void set_bitrate(uint32_t bps) {
+    bitrate_ = bps;
+  }
+
+  uint32_t airtime_us(size_t bytes) const {
+    return bitrate_ ? (uint32_t)((uint64_t)bytes * 8 * 1000000 / bitrate_) : 0;
+  }
+
+  /// clock and events
+
+  mesh_core::timestamp_t now() const {
+    return now_;
+  }
+
+  void schedule(uint32_t delay_ms, std::function<void()> handle) {
+    events_.push(event{now_ + delay_ms, event_seq_++, std::move(handle)});
+  }
+
+  /**
+   * run one event
+   * @return false if no event
+   */
+  bool step() {
+    if (events_.empty()) return false;
+    auto ev = std::move(const_cast<event&>(events_.top()));  // pop right after, safe to move
+    events_.pop();
+    now_ = ev.time;
+    ev.handle();
+    return true;
+  }
+
+  /**
+   * run events until virtual time `ms` later, the clock will be advanced to it
+   */
+  void run_for(uint32_t ms) {
+    run_until(now_ + ms);
+  }
+
+  void run_until(mesh_core::timestamp_t time) {
+    while (!events_.empty() && (int32_t)(events_.top().time - time) <= 0) {
+      step();
+    }
+    now_ = time;
+  }
+
+  /// statistics
+
+  const counter& total() const {
+    return total_;
+  }
+
+  const counter& node_counter(int id) const {
+    return node_counters_[id];
+  }
+
+  void reset_counter() {
+    total_ = {};
+    for (auto& c : node_counters_) {
+      c = {};
+    }
+  }
+
+ private:
+  friend class node_impl;
+
+  struct event {
+    mesh_core::timestamp_t time;
+    uint64_t seq;
+    std::function<void()> handle;
+
+    bool operator>(const event& other) const {
+      if (time != other.time) return (int32_t)(time - other.time) > 0;
+      return seq > other.seq;
+    }
+  };
+
+  int add_nodes(int n) {
+    int base = (int)nodes_.size();
+    for (int i = 0; i < n; ++i) {
+      add_node();
+    }
+    return base;
+  }
+
+  void set_edge(int a, int b, link_model model) {
+    for (auto& e : links_[a]) {
+      if (e.to == b) {
+        e.model = model;
+        return;
+      }
+    }
+    links_[a].push_back(edge{b, model});
+  }
+
+  void rm_edge(int a, int b) {
+    auto& l = links_[a];
+    for (auto it = l.begin(); it != l.end(); ++it) {
+      if (it->to == b) {
+        l.erase(it);
+        return;
+      }
+    }
+  }
+
+  void transmit(int from, mesh_core::data_view data) {
+    if (!up_[from]) return;
+    ++total_.tx_frames;
+    total_.tx_bytes += data.size();
+    ++node_counters_[from].tx_frames;
+    node_counters_[from].tx_bytes += data.size();
+    total_.tx_airtime_us += airtime_us(data.size());
+    node_counters_[from].tx_airtime_us += airtime_us(data.size());
+    bool ok;
+    auto msg = mesh_core::message_view::parse(data, ok);
+    if (ok) {
+      ++total_.tx_type_frames[(int)msg.type];
+      ++node_counters_[from].tx_type_frames[(int)msg.type];
+    }
+
+    auto frame = std::make_shared<std::string>(data.data(), data.size());
+    std::uniform_real_distribution<double> loss_dist(0, 1);
+    for (const auto& e : links_[from]) {
+      if ((e.model.loss > 0 && loss_dist(rng_) < e.model.loss) || (drop_filter_ && drop_filter_(from, e.to, *frame))) {
+        ++total_.lost_frames;
+        continue;
+      }
+      uint32_t latency = e.model.latency_ms;
+      if (e.model.jitter_ms) {
+        latency += std::uniform_int_distribution<uint32_t>(0, e.model.jitter_ms)(rng_);
+      }
+      int to = e.to;
+      auto lqs = e.model.lqs;
+      schedule(latency, [this, to, frame, lqs] {
+        auto& node = *nodes_[to];
+        if (!up_[to] || !node.recv_handle_) return;
+        ++total_.rx_frames;
+        ++node_counters_[to].rx_frames;
+        node.recv_handle_(*frame, lqs);
+      });
+    }
+  }
+
+ private:
+  std::mt19937 rng_;
+  mesh_core::timestamp_t now_;
+  uint64_t event_seq_ = 0;
+  std::priority_queue<event, std::vector<event>, std::greater<event>> events_;
+
+  std::vector<std::unique_ptr<node_impl>> nodes_;
+  std::vector<std::vector<edge>> links_;
+  std::vector<bool> up_;
+  std::function<bool(int, int, mesh_core::data_view)> drop_filter_;
+
+  counter total_;
+  std::vector<counter> node_counters_;
+  uint32_t bitrate_ = 0;
+};
+
+inline void node_impl::broadcast(mesh_core::data_view data) {
+  net_->transmit(id_, data);
+}
+
+inline mesh_core::timestamp_t node_impl::get_timestamp_ms() const {
+  return net_->now();
+}
+
+inline void node_impl::run_delay(std::function<void()> handle, uint32_t ms) {
+  net_->schedule(ms, std::move(handle));
+}
+
+inline uint32_t node_impl::airtime_us(size_t bytes) const {
+  return net_->airtime_us(bytes);
+}
+
+}  // namespace sim
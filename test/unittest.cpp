@@ -1,9 +1,14 @@
+#include <atomic>
+#include <memory>
+#include <thread>
 #include <unordered_map>
 #include <utility>
 
 #include "asio.hpp"
 #include "assert_def.h"
 #include "mesh_core.hpp"
+#include "mesh_core/concurrent_mesh.hpp"
+#include "mesh_core/mesh_host.hpp"
 #include "mesh_core/utils.hpp"
 
 static asio::io_context s_io_context;
@@ -14,7 +19,7 @@ struct Impl {
 
   explicit Impl(mesh_core::addr_t addr) : addr(addr) {}
 
-  void broadcast(const std::string& data) const {
+  void broadcast(mesh_core::data_view data) const {
     for (int i = 0; i < (int)recv_handles.size(); ++i) {
       if (std::abs(addr - i) > 1) {
         continue;
@@ -51,7 +56,7 @@ static void test_message() {
     m.seq = 0x34;
     m.ts = 0x5678;
     auto uuid = m.cal_uuid();
-    ASSERT(uuid == 0x12345678);
+    ASSERT(uuid == ((mesh_core::msg_uuid_t)0x12 << ((sizeof(mesh_core::seq_t) + 2) * 8) | 0x345678));
   }
   {
     // test serialize
@@ -66,7 +71,1460 @@ static void test_message() {
     ASSERT(ok);
     ASSERT(m.data == m2.data);
     ASSERT(m.crc == m2.crc);
+
+    // test serialize into buffer with segments
+    uint8_t buffer[mesh_core::message::SizeMax];
+    mesh_core::message m3;
+    mesh_core::data_view segs[] = {"he", "", "llo"};
+    auto size = m3.serialize_into(buffer, sizeof(buffer), segs, 3);
+    ASSERT(size == payload.size());
+    ASSERT(memcmp(buffer, payload.data(), size) == 0);
+    ASSERT(m3.serialize_into(buffer, size - 1, segs, 3) == 0);
+
+    // test parse in place
+    auto view = mesh_core::message_view::parse(payload, ok);
+    ASSERT(ok);
+    ASSERT(view.data == "hello");
+    ASSERT(view.data.data() >= payload.data() && view.data.end() <= payload.data() + payload.size());
+    ASSERT(view.crc == m.crc);
+
+    // test max size with next_hop
+    mesh_core::message m4;
+    m4.type = mesh_core::message_type::user_data;
+    m4.data.assign(mesh_core::message::DataSizeMax, 'x');
+    auto payload4 = m4.serialize(ok);
+    ASSERT(ok);
+    ASSERT(payload4.size() == mesh_core::message::SizeMax);
+    mesh_core::message_view::parse(payload4, ok);
+    ASSERT(ok);
+    m4.data.push_back('x');
+    m4.serialize(ok);
+    ASSERT(!ok);
+
+    // test crc error
+    payload[payload.size() / 2] ^= 0x01;
+    mesh_core::drop_reason reason{};
+    mesh_core::message_view::parse(payload, ok, &reason);
+    ASSERT(!ok);
+    ASSERT(reason == mesh_core::drop_reason::crc_error);
+    payload.pop_back();
+    mesh_core::message_view::parse(payload, ok, &reason);
+    ASSERT(reason == mesh_core::drop_reason::len_error);
+  }
+}
+
+static void test_proto() {
+  using proto = mesh_core::proto;
+  static_assert(proto::Narrow == (MESH_CORE_ADDR_BITS == 8 && MESH_CORE_SEQ_BITS == 8), "");
+  static_assert(!proto::Narrow || mesh_core::message::SizeHeader == 11, "8bit layout is unchanged");
+  static_assert(mesh_core::message::SizeHeader == 9 - proto::Narrow + 2 * sizeof(mesh_core::addr_t) + sizeof(mesh_core::seq_t), "");
+  ASSERT((proto::ProtoVer & 0x3F) == MESH_CORE_PROTO_VER);
+
+  // full range of address, sequence and ttl
+  mesh_core::message m;
+  m.type = mesh_core::message_type::user_data;
+  m.ttl = proto::TtlMax;
+  m.src = (mesh_core::addr_t)~0;
+  m.dst = (mesh_core::addr_t)(m.src - 1);
+  m.next_hop = (mesh_core::addr_t)(m.src - 2);
+  m.seq = (mesh_core::seq_t)~0;
+  m.data = "hello";
+  bool ok;
+  auto payload = m.serialize(ok);
+  ASSERT(ok);
+  ASSERT(payload.size() == mesh_core::message::SizeMin + sizeof(mesh_core::addr_t) + 5);
+  auto view = mesh_core::message_view::parse(payload, ok);
+  ASSERT(ok);
+  ASSERT(view.type == m.type && view.ttl == m.ttl);
+  ASSERT(view.src == m.src && view.dst == m.dst && view.next_hop == m.next_hop && view.seq == m.seq);
+  ASSERT(view.cal_uuid() == m.cal_uuid());
+  m.finalize();
+  ASSERT(m.len == payload.size() - mesh_core::message::SizeNotInLen);
+
+  // nodes with other widths are dropped
+  payload[1] = (char)(proto::ProtoVer ^ 0x40);
+  mesh_core::drop_reason reason{};
+  mesh_core::message_view::parse(payload, ok, &reason);
+  ASSERT(!ok && reason == mesh_core::drop_reason::version_error);
+}
+
+static void test_crc() {
+  const char* check = "123456789";
+  ASSERT(mesh_core::utils::crc16_nibble(check, 9) == 0x29B1);
+  ASSERT(mesh_core::utils::crc16_byte(check, 9) == 0x29B1);
+  ASSERT(mesh_core::utils::crc16_slice8(check, 9) == 0x29B1);
+  ASSERT(mesh_core::utils::crc16(check, 9) == 0x29B1);
+  ASSERT(mesh_core::utils::crc32c_sw(check, 9) == 0xE3069283);
+  ASSERT(mesh_core::utils::crc32c(check, 9) == 0xE3069283);
+
+  uint8_t data[300];
+  for (size_t i = 0; i < sizeof(data); ++i) {
+    data[i] = (uint8_t)(i * 7 + 3);
+  }
+  for (size_t size = 0; size < sizeof(data); size += 13) {
+    auto crc = mesh_core::utils::crc16_nibble(data, size);
+    ASSERT(mesh_core::utils::crc16_byte(data, size) == crc);
+    ASSERT(mesh_core::utils::crc16_slice8(data, size) == crc);
+#ifdef MESH_CORE_CRC32C_HW
+    ASSERT(mesh_core::utils::crc32c_hw(data, size) == mesh_core::utils::crc32c_sw(data, size));
+#endif
+  }
+
+  // integrity policy
+  mesh_core::message m;
+  m.data = "hello";
+  uint8_t buffer[mesh_core::message::frame_size<mesh_core::integrity::crc32c>::Max];
+  bool ok;
+  auto size = m.serialize_into<mesh_core::integrity::none>(buffer, sizeof(buffer));
+  ASSERT(size == mesh_core::message::SizeMin - 2 + 5);
+  auto view = mesh_core::message_view::parse<mesh_core::integrity::none>(mesh_core::data_view(buffer, size), ok);
+  ASSERT(ok && view.data == "hello");
+  size = m.serialize_into<mesh_core::integrity::crc32c>(buffer, sizeof(buffer));
+  ASSERT(size == mesh_core::message::SizeMin + 2 + 5);
+  view = mesh_core::message_view::parse<mesh_core::integrity::crc32c>(mesh_core::data_view(buffer, size), ok);
+  ASSERT(ok && view.data == "hello");
+  mesh_core::message_view::parse<mesh_core::integrity::crc16>(mesh_core::data_view(buffer, size), ok);
+  ASSERT(!ok);
+}
+
+static void test_route_table() {
+  mesh_core::route_table table;
+  ASSERT(table.size() == 0);
+  ASSERT(table.begin() == table.end());
+  for (int dst : {0x00, 0x1F, 0x20, 0x80, 0xFF}) {
+    mesh_core::route_info info;
+    info.dst = dst;
+    info.next_hop = 0x01;
+    info.metric = 1;
+    info.expired = 0;
+    table.add(info);
+  }
+  ASSERT(table.size() == 5);
+  ASSERT(table.find_node(0x20)->next_hop == 0x01);
+  ASSERT(table.find_node(0x21) == nullptr);
+
+  // add exist: update
+  mesh_core::route_info info;
+  info.dst = 0x80;
+  info.next_hop = 0x02;
+  info.metric = 2;
+  table.add(info);
+  ASSERT(table.size() == 5);
+  ASSERT(table.find_node(0x80)->next_hop == 0x02);
+
+  // iterate in order of dst
+  int count = 0;
+  int last = -1;
+  for (const auto& item : table) {
+    ASSERT(item.dst > last);
+    last = item.dst;
+    ++count;
+  }
+  ASSERT(count == 5);
+
+  table.rm(0x1F);
+  table.rm(0x1F);
+  ASSERT(table.size() == 4);
+  ASSERT(table.find_node(0x1F) == nullptr);
+
+  // static route and self are never expired
+  table.find_node(0x00)->metric = 0;
+  table.find_node(0xFF)->type = mesh_core::route_type::STATIC;
+  table.check_expired(MESH_CORE_ROUTE_EXPIRED_MS + 1);
+  ASSERT(table.size() == 2);
+  ASSERT(table.find_node(0x00) != nullptr);
+  ASSERT(table.find_node(0xFF) != nullptr);
+
+  // hold down: only accept the old next hop
+  info.dst = 0x30;
+  info.next_hop = 0x03;
+  info.metric = 2;
+  table.add(info);
+  table.withdraw(0x30, 1000);
+  ASSERT(table.find_node(0x30) == nullptr);
+  ASSERT(table.held_down(0x30, 0x04, 1000 + MESH_CORE_ROUTE_HOLD_DOWN_MS - 1));
+  ASSERT(!table.held_down(0x30, 0x03, 1000 + MESH_CORE_ROUTE_HOLD_DOWN_MS - 1));
+  ASSERT(!table.held_down(0x30, 0x04, 1000 + MESH_CORE_ROUTE_HOLD_DOWN_MS));
+  ASSERT(!table.held_down(0x31, 0x04, 1000));
+}
+
+static void test_dup_filter() {
+  std::unique_ptr<mesh_core::detail::dup_filter<>> filter(new mesh_core::detail::dup_filter<>());
+  auto& f = *filter;
+  const mesh_core::timestamp_t ts = 0x1000;
+
+  // new and duplicate
+  ASSERT(f.check_and_put(0x01, 10, ts));
+  ASSERT(!f.check_and_put(0x01, 10, ts));
+  // sources are independent
+  ASSERT(f.check_and_put(0x02, 10, ts));
+
+  // out of order in window
+  ASSERT(f.check_and_put(0x01, 12, ts + 2));
+  ASSERT(f.check_and_put(0x01, 11, ts + 1));
+  ASSERT(!f.check_and_put(0x01, 11, ts + 1));
+  ASSERT(!f.check_and_put(0x01, 12, ts + 2));
+
+  // more than 32 frames inside window, and seq wrap at 256
+  for (int i = 13; i < 13 + 300; ++i) {
+    ASSERT(f.check_and_put(0x01, (mesh_core::seq_t)i, ts + i));
+  }
+  for (int i = 13 + 300 - mesh_core::detail::dup_filter<>::WindowSize; i < 13 + 300; ++i) {
+    ASSERT(!f.check_and_put(0x01, (mesh_core::seq_t)i, ts + i));
+  }
+  // out of window
+  ASSERT(!f.check_and_put(0x01, (mesh_core::seq_t)(13 + 300 - mesh_core::detail::dup_filter<>::WindowSize - 1), ts + 100));
+
+  // source reboot: seq restart with newer ts
+  ASSERT(f.check_and_put(0x02, 0, ts + 50000));
+  ASSERT(f.check_and_put(0x02, 1, ts + 50001));
+  ASSERT(!f.check_and_put(0x02, 0, ts + 50000));
+  // source reboot: seq restart and timestamp restart
+  ASSERT(f.check_and_put(0x02, 1, 10));
+  ASSERT(!f.check_and_put(0x02, 1, 10));
+}
+
+#if MESH_CORE_ADDR_BITS == 16
+static void test_wide_address() {
+  // route table: hashed slots, bounded by MESH_CORE_ROUTE_TABLE_SIZE
+  std::unique_ptr<mesh_core::route_table> table(new mesh_core::route_table());
+  const size_t cap = mesh_core::route_table::Capacity;
+  mesh_core::route_info info;
+  info.next_hop = 0x0101;
+  info.metric = 1;
+  for (size_t i = 0; i < cap; ++i) {
+    info.dst = (mesh_core::addr_t)(0x0100 + i * 7);
+    ASSERT(table->add(info));
+  }
+  info.dst = 0xFFFF;
+  ASSERT(!table->add(info));
+  ASSERT(table->size() == cap);
+  for (size_t i = 0; i < cap; ++i) {
+    auto node = table->find_node((mesh_core::addr_t)(0x0100 + i * 7));
+    ASSERT(node && node->dst == (mesh_core::addr_t)(0x0100 + i * 7));
+  }
+  ASSERT(table->find_node(0xFFFF) == nullptr);
+
+  // removed slot is advertised with its dst, then reused
+  table->clear_dirty();
+  table->rm(0x0100);
+  size_t slot = table->next_dirty(0);
+  ASSERT(slot < cap && !table->slot_used(slot) && table->slot(slot).dst == 0x0100);
+  ASSERT(!table->add(info));
+  table->clear_dirty();
+  ASSERT(table->add(info));
+  ASSERT(table->find_node(0xFFFF) != nullptr && table->find_node(0x0100) == nullptr);
+
+  // withdrawn slot is kept during hold down
+  table->withdraw(0xFFFF, 1000);
+  table->clear_dirty();
+  info.dst = 0xFFFE;
+  ASSERT(!table->add(info));
+  ASSERT(table->held_down(0xFFFF, 0x0102, 1000));
+  table->check_expired(1000 + MESH_CORE_ROUTE_HOLD_DOWN_MS);
+  table->clear_dirty();
+  ASSERT(table->add(info));
+
+  // churn: released slots are unassigned, probing does not degrade to the whole table
+  std::vector<mesh_core::addr_t> dsts;
+  table->for_each([&](const mesh_core::route_info& r) {
+    dsts.push_back(r.dst);
+  });
+  for (auto dst : dsts) {
+    table->rm(dst);
   }
+  ASSERT(table->assigned() == cap);
+  table->clear_dirty();
+  ASSERT(table->size() == 0 && table->assigned() == 0);
+  for (size_t round = 0; round < 16; ++round) {
+    for (size_t i = 0; i < cap / 2; ++i) {
+      info.dst = (mesh_core::addr_t)(0x2000 + round * cap + i * 3);
+      ASSERT(table->add(info));
+    }
+    // remove from the middle of probe chains, the rest is still found
+    for (size_t i = 0; i < cap / 2; i += 2) {
+      table->rm((mesh_core::addr_t)(0x2000 + round * cap + i * 3));
+    }
+    table->withdraw((mesh_core::addr_t)(0x2000 + round * cap + 3), 2000);
+    table->clear_dirty();
+    for (size_t i = 3; i < cap / 2; i += 2) {
+      ASSERT(table->find_node((mesh_core::addr_t)(0x2000 + round * cap + i * 3)) != nullptr);
+    }
+    table->check_expired(2000 + MESH_CORE_ROUTE_HOLD_DOWN_MS);
+    for (size_t i = 3; i < cap / 2; i += 2) {
+      table->rm((mesh_core::addr_t)(0x2000 + round * cap + i * 3));
+    }
+    table->clear_dirty();
+    ASSERT(table->size() == 0 && table->assigned() == 0);
+  }
+
+  // dup filter: least recently heard source is replaced
+  using dup_filter = mesh_core::detail::dup_filter<>;
+  std::unique_ptr<dup_filter> filter(new dup_filter());
+  const size_t sets = dup_filter::SourceNum / dup_filter::Ways;
+  for (size_t w = 0; w < dup_filter::Ways; ++w) {
+    ASSERT(filter->check_and_put((mesh_core::addr_t)(w * sets), 0x1234, 0));
+  }
+  ASSERT(!filter->check_and_put(0, 0x1234, 0));
+  ASSERT(filter->check_and_put((mesh_core::addr_t)(dup_filter::Ways * sets), 0x1234, 0));
+  ASSERT(filter->size() == dup_filter::Ways);
+  ASSERT(!filter->check_and_put(0, 0x1234, 0));
+  ASSERT(filter->check_and_put((mesh_core::addr_t)sets, 0x1234, 0));
+}
+#endif
+
+static void test_rebroadcast_table() {
+  mesh_core::detail::rebroadcast_table<> table;
+  mesh_core::detail::rebroadcast_table<>::handle h1{}, h2{};
+
+  // not enough copies
+  ASSERT(table.add(0x01, 1, 0, h1));
+  ASSERT(!table.on_copy(0x01, 1, 0));
+  ASSERT(!table.on_copy(0x01, 2, 0));
+  ASSERT(table.take(h1));
+  ASSERT(!table.take(h1));
+
+  // cancelled by counter, slot reuse
+  ASSERT(table.add(0x01, 2, 0, h2));
+  for (int i = 1; i < MESH_CORE_REBROADCAST_COUNTER_THRESHOLD - 1; ++i) {
+    ASSERT(!table.on_copy(0x01, 2, 0));
+  }
+  ASSERT(table.on_copy(0x01, 2, 0));
+  ASSERT(!table.take(h2));
+
+  // cancelled by a close neighbor
+  ASSERT(table.add(0x02, 1, -50, h1));
+  ASSERT(table.on_copy(0x02, 1, -50 + MESH_CORE_REBROADCAST_LQS_MARGIN));
+  ASSERT(!table.take(h1));
+
+  // full
+  mesh_core::detail::rebroadcast_table<>::handle h{};
+  for (size_t i = 0; i < mesh_core::detail::rebroadcast_table<>::Capacity; ++i) {
+    ASSERT(table.add(0x03, (mesh_core::seq_t)i, 0, h));
+  }
+  ASSERT(!table.add(0x03, 0xFF, 0, h));
+}
+
+#ifdef MESH_CORE_ENABLE_MPR
+static void test_mpr_selector() {
+  std::unique_ptr<mesh_core::detail::mpr_selector> selector(new mesh_core::detail::mpr_selector());
+  auto& s = *selector;
+  // self: 0, neighbors: 1 2 3, two hop: 1->4,5 2->5,6 3->6
+  mesh_core::detail::mpr_selector::addr_set neighbors, changed;
+  neighbors.set(1);
+  neighbors.set(2);
+  neighbors.set(3);
+  for (int n = 1; n <= 3; ++n) {
+    s.set_two_hop((mesh_core::addr_t)n, 0, true);
+  }
+  s.set_two_hop(1, 4, true);
+  s.set_two_hop(1, 5, true);
+  s.set_two_hop(2, 5, true);
+  s.set_two_hop(2, 6, true);
+  s.set_two_hop(3, 6, true);
+  s.set_two_hop(3, 2, true);  // neighbor is not two hop
+
+  ASSERT(s.update(neighbors, 0, changed));
+  ASSERT(s.is_mpr(1));  // only one reach 4
+  ASSERT(s.is_mpr(2));
+  ASSERT(!s.is_mpr(3));
+  ASSERT(changed.count() == 2);
+  ASSERT(!s.update(neighbors, 0, changed));
+
+  // 1 lost 4 and 5, 3 reach 4
+  s.set_two_hop(1, 4, false);
+  s.set_two_hop(1, 5, false);
+  s.set_two_hop(3, 4, true);
+  ASSERT(s.update(neighbors, 0, changed));
+  ASSERT(!s.is_mpr(1));
+  ASSERT(s.is_mpr(2));
+  ASSERT(s.is_mpr(3));
+  ASSERT(changed.test(1) && changed.test(3) && !changed.test(2));
+
+  s.set_selector(5, true);
+  ASSERT(s.is_selector(5));
+  s.set_selector(5, false);
+  ASSERT(!s.is_selector(5));
+}
+#endif
+
+static void test_inplace_function() {
+  using mesh_core::detail::inplace_function;
+  inplace_function<int(int)> f;
+  ASSERT(!f);
+  ASSERT(f == nullptr);
+
+  int base = 10;
+  f = [&base](int v) {
+    return base + v;
+  };
+  ASSERT(f);
+  ASSERT(f(1) == 11);
+
+  // move only capture, destroyed once
+  auto counter = std::make_shared<int>(0);
+  inplace_function<void()> g = [counter, p = std::unique_ptr<int>(new int(1))] {
+    ++*counter;
+  };
+  ASSERT(counter.use_count() == 2);
+  auto h = std::move(g);
+  ASSERT(!g);
+  h();
+  ASSERT(*counter == 1);
+  ASSERT(counter.use_count() == 2);
+  h = nullptr;
+  ASSERT(counter.use_count() == 1);
+
+  // result ignored
+  inplace_function<void()> v = [] {
+    return 1;
+  };
+  v();
+}
+
+static void test_frame_pool() {
+  using pool_t = mesh_core::detail::frame_pool<8, 2>;
+  pool_t pool;
+  pool_t::handle h1{}, h2{}, h3{};
+  mesh_core::data_view data;
+
+  ASSERT(pool.alloc("123456789", h1) == pool_t::result::too_large);
+  ASSERT(pool.alloc("a", h1) == pool_t::result::ok);
+  ASSERT(pool.alloc("bb", h2) == pool_t::result::ok);
+  ASSERT(pool.get(h1, data) && data == "a");
+  ASSERT(pool.get(h2, data) && data == "bb");
+
+  // full
+#if MESH_CORE_FRAME_POOL_POLICY == 0
+  ASSERT(pool.alloc("c", h3) == pool_t::result::full);
+  ASSERT(pool.valid(h1));
+#else
+  ASSERT(pool.alloc("c", h3) == pool_t::result::evicted);
+  ASSERT(!pool.get(h1, data));
+  ASSERT(pool.get(h3, data) && data == "c");
+  pool.release(h3);
+#endif
+
+  pool.release(h1);
+  pool.release(h1);
+  ASSERT(!pool.valid(h1));
+  ASSERT(pool.size() == 1);
+  ASSERT(pool.alloc("d", h3) == pool_t::result::ok);
+  ASSERT(h3.index == h1.index && !pool.valid(h1));
+  ASSERT(pool.get(h3, data) && data == "d");
+}
+
+#ifdef MESH_CORE_ENABLE_FRAGMENT
+static void test_reassembly() {
+  using reasm_t = mesh_core::detail::reassembly<4, 2, 10>;
+  using result = reasm_t::result;
+  reasm_t r;
+  mesh_core::data_view payload;
+  uint32_t dropped = 0;
+  auto frag = [](uint8_t id, uint16_t index, uint16_t count) {
+    mesh_core::fragment_msg f;
+    f.id = id;
+    f.index = index;
+    f.count = count;
+    return f;
+  };
+
+  // out of order and duplicate
+  ASSERT(r.add(0, 1, frag(0, 2, 3), "ij", true, payload, dropped) == result::ok);
+  ASSERT(r.add(0, 1, frag(0, 0, 3), "abcd", true, payload, dropped) == result::ok);
+  ASSERT(r.add(0, 1, frag(0, 0, 3), "abcd", true, payload, dropped) == result::duplicate);
+  ASSERT(r.size() == 1);
+  ASSERT(r.add(0, 1, frag(0, 1, 3), "efgh", true, payload, dropped) == result::complete);
+  ASSERT(payload == "abcdefghij");
+  ASSERT(r.size() == 0);
+
+  // bad header, exceed buffer
+  ASSERT(r.add(0, 1, frag(1, 3, 3), "ab", true, payload, dropped) == result::error);
+  ASSERT(r.add(0, 1, frag(1, 0, 3), "ab", true, payload, dropped) == result::error);
+  ASSERT(r.add(0, 1, frag(1, 0, 4), "abcd", true, payload, dropped) == result::too_large);
+  ASSERT(r.add(0, 1, frag(1, 0, 3), "abcd", true, payload, dropped) == result::ok);
+  ASSERT(r.add(0, 1, frag(1, 2, 3), "ijk", true, payload, dropped) == result::too_large);
+  ASSERT(dropped == 1 && r.size() == 0);
+
+  // no buffer needed if not store
+  ASSERT(r.add(0, 1, frag(2, 0, 4), "abcd", false, payload, dropped) == result::ok);
+  ASSERT(r.add(0, 2, frag(0, 0, 2), "abcd", false, payload, dropped) == result::ok);
+  ASSERT(r.add(0, 3, frag(0, 0, 2), "abcd", false, payload, dropped) == result::full);
+
+  // newer payload from the same source, and timeout
+  ASSERT(r.add(0, 1, frag(3, 0, 2), "abcd", false, payload, dropped) == result::ok);
+  ASSERT(dropped == 2);
+  ASSERT(r.add(MESH_CORE_REASSEMBLY_TIMEOUT_MS + 1, 3, frag(0, 0, 2), "abcd", false, payload, dropped) == result::ok);
+  ASSERT(dropped == 4 && r.size() == 1);
+}
+#endif
+
+#ifdef MESH_CORE_ENABLE_RELIABLE
+static void test_reliable() {
+  using namespace mesh_core;
+  {
+    detail::rtt_estimator rtt;
+    ASSERT(rtt.rto() == MESH_CORE_RELIABLE_RTO_INIT_MS);
+    rtt.update(1000);
+    ASSERT(rtt.srtt() == 1000 && rtt.rto() == 3000);
+    for (int i = 0; i < 50; ++i) {
+      rtt.update(1000);
+    }
+    ASSERT(rtt.rto() < 1100);
+    rtt.update(0);
+    ASSERT(rtt.rto() >= MESH_CORE_RELIABLE_RTO_MIN_MS);
+  }
+  {
+    detail::reliable_rx<2> rx;
+    reliable_msg m;
+    ack_msg ack;
+    m.base = 250;
+    m.flags = reliable_msg::FlagSyn;
+
+    // out of order and duplicate
+    m.seq = 251;
+    ASSERT(rx.on_data(0, 1, m, ack) && ack.cum == 250 && ack.sack == 1);
+    ASSERT(!rx.on_data(0, 1, m, ack));
+    m.seq = 250;
+    ASSERT(rx.on_data(0, 1, m, ack) && ack.cum == 252 && ack.sack == 0);
+    ASSERT(!rx.on_data(0, 1, m, ack) && ack.cum == 252);
+
+    // seq wraps, the source gave up 252
+    m.flags = 0;
+    m.base = 253;
+    m.seq = 1;
+    ASSERT(rx.on_data(0, 1, m, ack) && ack.cum == 253 && ack.sack == (1u << 3));
+
+    // the source restarted
+    m.flags = reliable_msg::FlagSyn;
+    m.base = 100;
+    m.seq = 100;
+    ASSERT(rx.on_data(0, 1, m, ack) && ack.cum == 101);
+  }
+  {
+    detail::reliable_tx<8, 3, 2, 2> tx;
+    int a = tx.add(0, 1, "a", 10);
+    int b = tx.add(0, 1, "b", 0);
+    ASSERT(a >= 0 && b >= 0 && tx.size() == 2);
+    // window
+    ASSERT(tx.add(0, 1, "c", 0) < 0);
+    ASSERT(tx.add(0, 1, "123456789", 0) < 0);
+
+    addr_t dst;
+    reliable_msg m;
+    data_view data;
+    ASSERT(tx.frame(b, dst, m, data));
+    ASSERT(dst == 1 && m.seq == 11 && m.base == 10 && (m.flags & reliable_msg::FlagSyn) && data == "b");
+    tx.at(b).tries = 3;
+    ASSERT(tx.rto(b) == MESH_CORE_RELIABLE_RTO_INIT_MS * 4);
+
+    // selective ack, a is still missing
+    ack_msg ack;
+    ack.cum = 10;
+    ack.sack = 1;
+    ASSERT(tx.on_ack(0, 1, ack, 100) == (1u << b));
+    ASSERT(tx.srtt(1) == 100);
+    tx.release(b);
+    ASSERT(tx.frame(a, dst, m, data) && m.base == 10 && m.flags == 0);
+    // window is blocked by a
+    ASSERT(tx.add(0, 1, "c", 0) < 0);
+    ack.cum = 12;
+    ack.sack = 0;
+    ASSERT(tx.on_ack(0, 1, ack, 100) == (1u << a));
+    tx.release(a);
+    int c = tx.add(0, 1, "c", 0);
+    ASSERT(c >= 0 && tx.frame(c, dst, m, data) && m.seq == 12 && m.base == 12);
+
+    // pool full
+    ASSERT(tx.add(0, 2, "d", 0) >= 0);
+    ASSERT(tx.add(0, 2, "e", 0) >= 0);
+    ASSERT(tx.size() == 3);
+    ASSERT(tx.add(0, 2, "f", 0) < 0);
+  }
+}
+#endif
+
+#ifdef MESH_CORE_ENABLE_HOP_ACK
+static void test_hop_ack_table() {
+  mesh_core::detail::hop_ack_table<8, 2> t;
+  mesh_core::data_view frame;
+  int a = t.add(0x1234, 5, 2, 4, "a");
+  int b = t.add(0x5678, 5, 2, 4, "b");
+  ASSERT(a >= 0 && b >= 0 && a != b);
+  ASSERT(t.add(0x9ABC, 5, 2, 4, "c") < 0);
+  ASSERT(t.frame(b, frame) && frame == "b");
+
+  // only a forwarded copy is an ack
+  ASSERT(t.on_copy(0x1234, 5) < 0);
+  ASSERT(t.on_copy(0x1111, 4) < 0);
+  ASSERT(t.on_copy(0x1234, 4) == a);
+  t.release(a);
+  ASSERT(t.find(0x1234) < 0 && t.size() == 1);
+
+  mesh_core::route_table table;
+  mesh_core::route_info info;
+  info.dst = 3;
+  info.next_hop = 2;
+  info.metric = 2;
+  table.add(info);
+  info.dst = 4;
+  info.next_hop = 4;
+  info.metric = 1;
+  table.add(info);
+  ASSERT(table.degrade(2, 1000) == 1);
+  ASSERT(table.find_node(3)->lqs < table.find_node(4)->lqs);
+
+  // the mark outlives the next route info, until restored or expired
+  ASSERT(table.degraded(2, 1000 + MESH_CORE_ROUTE_DEGRADE_MS - 1));
+  ASSERT(!table.degraded(4, 1000));
+  ASSERT(!table.degraded(2, 1000 + MESH_CORE_ROUTE_DEGRADE_MS));
+  table.degrade(2, 2000);
+  table.restore(2);
+  ASSERT(!table.degraded(2, 2000));
+  for (int i = 0; i < MESH_CORE_ROUTE_DEGRADE_NUM + 1; ++i) {
+    table.degrade((mesh_core::addr_t)(10 + i), 3000 + i);
+  }
+  ASSERT(!table.degraded(10, 3000 + MESH_CORE_ROUTE_DEGRADE_NUM));
+  ASSERT(table.degraded(11, 3000 + MESH_CORE_ROUTE_DEGRADE_NUM));
+}
+#endif
+
+static void test_tx_queue() {
+  using queue_t = mesh_core::detail::tx_queue<8, 3>;
+  using mesh_core::tx_priority;
+  queue_t q;
+  mesh_core::data_view frame;
+  uint8_t tag = 0;
+  uint32_t expired = 0;
+  ASSERT(!q.front(0, frame, tag, expired));
+
+  ASSERT(q.push(tx_priority::flood, 100, "f1", 1) == queue_t::result::ok);
+  ASSERT(q.push(tx_priority::unicast, 100, "u1", 2) == queue_t::result::ok);
+  ASSERT(q.push(tx_priority::unicast, 100, "u2", 3) == queue_t::result::ok);
+  // full, evict lower priority
+  ASSERT(q.push(tx_priority::routing, 100, "r1", 4) == queue_t::result::evicted);
+  ASSERT(q.push(tx_priority::flood, 100, "f2") == queue_t::result::full);
+  ASSERT(q.push(tx_priority::unicast, 100, "u3") == queue_t::result::full);
+  ASSERT(q.push(tx_priority::routing, 100, "123456789") == queue_t::result::too_large);
+
+  // priority order, FIFO in class
+  ASSERT(q.front(0, frame, tag, expired) && frame == "r1" && tag == 4);
+  q.pop();
+  ASSERT(q.front(0, frame, tag, expired) && frame == "u1" && tag == 2);
+  q.pop();
+  ASSERT(q.size() == 1);
+
+  // expired
+  ASSERT(q.push(tx_priority::flood, 200, "f3") == queue_t::result::ok);
+  ASSERT(q.front(150, frame, tag, expired) && frame == "f3");
+  ASSERT(expired == 1);
+  q.pop();
+  ASSERT(q.size() == 0);
+}
+
+/**
+ * Impl with tx done, frames are sent one by one
+ */
+struct TxImpl {
+  mesh_core::timestamp_t now = 1000;
+  std::vector<mesh_core::message_type> tx_types;
+  mesh_core::recv_handle_t recv_handle;
+  mesh_core::tx_done_handle_t tx_done;
+
+  void broadcast(mesh_core::data_view payload) {
+    bool ok;
+    auto msg = mesh_core::message_view::parse(payload, ok);
+    ASSERT(ok);
+    tx_types.push_back(msg.type);
+  }
+
+  void set_recv_handle(mesh_core::recv_handle_t handle) {
+    recv_handle = std::move(handle);
+  }
+
+  void set_tx_done_handle(mesh_core::tx_done_handle_t handle) {
+    tx_done = std::move(handle);
+  }
+
+  mesh_core::timestamp_t get_timestamp_ms() const {
+    return now;
+  }
+};
+
+static void test_tx_done() {
+  using mesh_core::message_type;
+  TxImpl impl;
+  {
+    mesh_core::mesh<TxImpl> mesh(&impl);
+    mesh.init(0x01);
+    ASSERT(impl.tx_done);
+    ASSERT(impl.tx_types.size() == 1);
+
+    // wait for tx done, backpressure when full
+    for (size_t i = 0; i < MESH_CORE_TX_QUEUE_NUM; ++i) {
+      ASSERT(mesh.send(0x02, "data"));
+    }
+    ASSERT(!mesh.send(0x02, "data"));
+    ASSERT(mesh.tx_pending() == MESH_CORE_TX_QUEUE_NUM);
+    ASSERT(impl.tx_types.size() == 1);
+
+    // route first
+    mesh.sync_route();
+    impl.tx_done();
+    ASSERT(impl.tx_types.size() == 2);
+    ASSERT(impl.tx_types.back() == message_type::route_info);
+    impl.tx_done();
+    ASSERT(impl.tx_types.back() == message_type::user_data);
+
+    // stale frames are dropped
+    impl.now += MESH_CORE_TX_DEADLINE_MS + 1;
+    impl.tx_done();
+    ASSERT(impl.tx_types.size() == 3);
+    ASSERT(mesh.tx_pending() == 0);
+#ifdef MESH_CORE_ENABLE_STATS
+    ASSERT(mesh.stats().drop(mesh_core::drop_reason::tx_queue_full) == 2);
+    ASSERT(mesh.stats().drop(mesh_core::drop_reason::tx_expired) == MESH_CORE_TX_QUEUE_NUM - 2);
+#endif
+  }
+  // kept by Impl, does nothing once mesh is destroyed
+  size_t tx_num = impl.tx_types.size();
+  ASSERT(impl.tx_done);
+  impl.tx_done();
+  ASSERT(impl.tx_types.size() == tx_num);
+}
+
+static void test_airtime_budget() {
+  mesh_core::detail::airtime_budget b;
+  ASSERT(!b.enabled());
+  ASSERT(b.allow(0, UINT32_MAX));
+  ASSERT(b.remaining(0) == UINT32_MAX);
+
+  // 1% of 16s: 160ms, slot: 1s
+  const uint32_t slots = mesh_core::detail::airtime_budget::SlotNum;
+  const uint32_t window = 1000 * slots;
+  b.set_limit(1000, 10, window);
+  ASSERT(b.remaining(1000) == 10 * window);
+  b.consume(1000, 10 * window - 100);
+  ASSERT(b.allow(1500, 100));
+  ASSERT(!b.allow(1500, 101));
+  ASSERT(!b.allow(1500, 50, 60));
+
+  // the first slot leaves the window after its end is one window old
+  ASSERT(b.wait_ms(1500, 101) == window + 500);
+  ASSERT(!b.allow(1000 + window + 999, 101));
+  ASSERT(b.allow(1000 + window + 1000, 101));
+  ASSERT(b.remaining(1000 + window + 1000) == 10 * window);
+  ASSERT(b.wait_ms(1000 + window + 1000, 10 * window + 1) == UINT32_MAX);
+
+  // long idle
+  b.consume(100000, 500);
+  ASSERT(b.remaining(100000 + window * 3) == 10 * window);
+}
+
+static void test_timer_wheel() {
+  using mesh_core::detail::timer_wheel;
+  std::unique_ptr<timer_wheel> wheel(new timer_wheel(1000));
+  auto& w = *wheel;
+  ASSERT(w.next_timeout(1000) == UINT32_MAX);
+
+  // one shot
+  int a = 0;
+  ASSERT(w.add(1000, 10, [&] {
+    ++a;
+  }) != 0);
+  ASSERT(w.next_timeout(1000) == 10);
+  ASSERT(w.next_timeout(1004) == 6);
+  w.poll(1009);
+  ASSERT(a == 0);
+  w.poll(1010);
+  ASSERT(a == 1);
+  ASSERT(w.size() == 0);
+
+  // periodic and cancel
+  int b = 0;
+  auto id = w.add(1010, 5, [&] {
+    ++b;
+  },
+               5);
+  w.poll(1031);
+  ASSERT(b == 4);
+  ASSERT(w.cancel(id));
+  ASSERT(!w.cancel(id));
+  w.poll(1100);
+  ASSERT(b == 4);
+
+  // cancel self in callback
+  int c = 0;
+  timer_wheel::id_t self = 0;
+  self = w.add(1100, 1, [&] {
+    ++c;
+    w.cancel(self);
+  },
+               1);
+  w.poll(1110);
+  ASSERT(c == 1);
+  ASSERT(w.size() == 0);
+
+  // long delay, cascade from higher levels
+  int d = 0;
+  w.add(1110, 100000, [&] {
+    ++d;
+  });
+  ASSERT(w.next_timeout(1110) <= 100000);
+  w.poll(1110 + 99999);
+  ASSERT(d == 0);
+  w.poll(1110 + 100000);
+  ASSERT(d == 1);
+
+  // one poll for a long time, timers on different levels run in order
+  std::vector<int> order;
+  w.add(110000, 5000, [&] {
+    order.push_back(3);
+  });
+  w.add(110000, 100, [&] {
+    order.push_back(2);
+  });
+  w.add(110000, 5, [&] {
+    order.push_back(1);
+  });
+  w.poll(120000);
+  ASSERT(order.size() == 3 && order[0] == 1 && order[1] == 2 && order[2] == 3);
+
+  // full
+  for (size_t i = 0; i < timer_wheel::Capacity; ++i) {
+    ASSERT(w.add(200000, 1, [] {}) != 0);
+  }
+  ASSERT(w.add(200000, 1, [] {}) == 0);
+  w.poll(200001);
+  ASSERT(w.size() == 0);
+}
+
+/**
+ * Impl without run_delay, driven by mesh::poll()
+ */
+struct PollImpl {
+  mesh_core::timestamp_t now = 1000;
+  int tx_frames = 0;
+  mesh_core::recv_handle_t recv_handle;
+
+  void broadcast(mesh_core::data_view) {
+    ++tx_frames;
+  }
+
+  void set_recv_handle(mesh_core::recv_handle_t handle) {
+    recv_handle = std::move(handle);
+  }
+
+  mesh_core::timestamp_t get_timestamp_ms() const {
+    return now;
+  }
+};
+
+static void test_poll_driven() {
+  PollImpl impl;
+  {
+    mesh_core::mesh<PollImpl> mesh(&impl);
+    mesh.init(0x01);
+    ASSERT(impl.recv_handle);
+    ASSERT(impl.tx_frames == 1);
+    ASSERT(mesh.next_timeout() <= MESH_CORE_ROUTE_SYNC_INTERVAL_MS);
+
+    impl.now += MESH_CORE_ROUTE_SYNC_INTERVAL_MS * 3;
+    mesh.poll();
+    ASSERT(impl.tx_frames == 4);
+
+    // broadcast burst from a neighbor, pending rebroadcasts are limited by the frame pool
+    const int burst = (int)MESH_CORE_FRAME_POOL_NUM + 2;
+    for (int i = 0; i < burst; ++i) {
+      mesh_core::message m;
+      m.type = mesh_core::message_type::broadcast;
+      m.src = 0x02;
+      m.seq = (mesh_core::seq_t)i;
+      m.ttl = mesh_core::TTL_DEFAULT;
+      m.ts = impl.now;
+      m.next_hop = 0x02;
+      m.data = std::string(mesh_core::message::DataSizeMax, 'x');
+      bool ok;
+      impl.recv_handle(m.serialize(ok), 0);
+      ASSERT(ok);
+    }
+    impl.now += MESH_CORE_DELAY_MS_MAX + 1;
+    mesh.poll();
+#if MESH_CORE_FRAME_POOL_POLICY == 0
+    ASSERT(impl.tx_frames == 4 + (int)MESH_CORE_FRAME_POOL_NUM);
+#ifdef MESH_CORE_ENABLE_STATS
+    ASSERT(mesh.stats().drop(mesh_core::drop_reason::pool_full) == 2);
+#endif
+#endif
+  }
+  // Impl keeps the handle, it does nothing once mesh is destroyed
+  ASSERT(impl.recv_handle);
+  int tx_frames = impl.tx_frames;
+  mesh_core::message m;
+  m.type = mesh_core::message_type::route_info_and_request;
+  m.src = 0x02;
+  m.ttl = 1;
+  m.ts = impl.now;
+  m.next_hop = 0x02;
+  bool ok;
+  impl.recv_handle(m.serialize(ok), 0);
+  ASSERT(ok && impl.tx_frames == tx_frames);
+}
+
+/**
+ * keep the last frame
+ */
+struct FrameImpl : PollImpl {
+  std::string last;
+
+  void broadcast(mesh_core::data_view frame) {
+    ++tx_frames;
+    last.assign(frame.data(), frame.size());
+  }
+};
+
+/**
+ * run `hook` once inside the next broadcast, like an Impl completing tx inline
+ */
+struct HookImpl : FrameImpl {
+  std::function<void()> hook;
+
+  void broadcast(mesh_core::data_view frame) {
+    FrameImpl::broadcast(frame);
+    auto h = std::move(hook);
+    hook = nullptr;
+    if (h) h();
+  }
+};
+
+static void test_route_delta() {
+  HookImpl impl;
+  mesh_core::mesh<HookImpl> mesh(&impl);
+  mesh.init(0x01);
+  // changed while the delta is sent, advertised by the next delta
+  impl.hook = [&] {
+    mesh.add_static_route(0x20, 0x21);
+  };
+  mesh.add_static_route(0x10, 0x11);
+  bool advertised = false;
+  for (int i = 0; i < 2 && !advertised; ++i) {
+    int tx_frames = impl.tx_frames;
+    impl.now += MESH_CORE_ROUTE_TRIGGER_INTERVAL_MS + MESH_CORE_DELAY_MS_MAX + 1;
+    mesh.poll();
+    if (impl.tx_frames == tx_frames) continue;
+    bool ok;
+    auto view = mesh_core::message_view::parse(impl.last, ok);
+    ASSERT(ok && view.type == mesh_core::message_type::route_info);
+    auto rms = (const mesh_core::route_msg*)view.data.data();
+    for (size_t n = 0; n < view.data.size() / sizeof(mesh_core::route_msg); ++n) {
+      if (rms[n].dst == 0x20 && rms[n].next_hop == 0x21) advertised = true;
+    }
+  }
+  ASSERT(advertised);
+}
+
+/**
+ * deliver frames to the peer inside broadcast, so a reply comes back before broadcast returns
+ */
+struct LoopImpl : PollImpl {
+  LoopImpl* peer = nullptr;
+  int reliable_frames = 0;
+
+  void broadcast(mesh_core::data_view frame) {
+    ++tx_frames;
+    bool ok;
+    if (mesh_core::message_view::parse(frame, ok).type == mesh_core::message_type::reliable_data && ok) ++reliable_frames;
+    if (peer && peer->recv_handle) peer->recv_handle(frame, 0);
+  }
+};
+
+#ifdef MESH_CORE_ENABLE_RELIABLE
+static void test_reliable_loopback() {
+  LoopImpl a;
+  LoopImpl b;
+  a.peer = &b;
+  b.peer = &a;
+  mesh_core::mesh<LoopImpl> ma(&a);
+  mesh_core::mesh<LoopImpl> mb(&b);
+  ma.init(0x01);
+  mb.init(0x02);
+  ma.sync_route();
+  ASSERT(ma.get_route(0x02));
+
+  int recv = 0;
+  mb.on_recv([&recv](mesh_core::addr_t, mesh_core::data_view) { ++recv; });
+  int done = 0;
+  bool second = false;
+  // acked inside send_reliable, the done handle reuses the slot for another message
+  ASSERT(ma.send_reliable(0x02, "first", [&](bool ok) {
+    ASSERT(ok);
+    ++done;
+    ASSERT(ma.send_reliable(0x02, "second", [&](bool ok) {
+      ASSERT(ok);
+      second = true;
+    }));
+  }));
+  ASSERT(done == 1 && second && recv == 2);
+  ASSERT(ma.reliable_pending() == 0);
+
+  // no timer is left for the released slot
+  for (int i = 0; i < MESH_CORE_RELIABLE_RETRY + 2; ++i) {
+    a.now += MESH_CORE_RELIABLE_RTO_MAX_MS;
+    b.now = a.now;
+    ma.poll();
+    mb.poll();
+  }
+  ASSERT(a.reliable_frames == 2);
+  ASSERT(done == 1 && recv == 2);
+#ifdef MESH_CORE_ENABLE_STATS
+  ASSERT(ma.stats().retransmits == 0);
+#endif
+}
+#endif
+
+struct leaf_config : mesh_core::default_config {
+  static const bool Route = false;
+  static const bool TimeSync = false;
+  static const bool RouteDebug = false;
+  static const bool BroadcastInterceptor = false;
+  static const bool DispatchInterceptor = false;
+  static const bool Stats = false;
+  static const bool Mpr = false;
+  static const bool Fragment = false;
+  static const bool Reliable = false;
+  static const bool HopAck = false;
+  static const mesh_core::ttl_t Ttl = 4;
+  static const size_t FramePoolNum = 1;
+  static const size_t TimerNum = 8;
+  static const uint16_t DutyCyclePermille = 10;
+};
+
+struct gateway_config : mesh_core::default_config {
+  static const bool TimeSync = true;
+  static const bool BroadcastInterceptor = true;
+  static const bool Stats = true;
+  static const bool Mpr = sizeof(mesh_core::addr_t) == 1;
+  static const bool Fragment = true;
+  static const bool Reliable = true;
+  static const bool HopAck = true;
+  static const size_t FramePoolNum = 16;
+  static const size_t ReliableTxNum = 2;
+};
+
+static void test_config() {
+  using leaf_t = mesh_core::mesh<FrameImpl, leaf_config>;
+  using gateway_t = mesh_core::mesh<FrameImpl, gateway_config>;
+  static_assert(sizeof(leaf_t) < sizeof(gateway_t), "disabled features have no storage");
+  static_assert(sizeof(gateway_t) - sizeof(leaf_t) > sizeof(mesh_core::route_table) / 2, "a leaf has no full route table");
+  // integrity policy as Config for default config
+  static_assert(std::is_same<mesh_core::mesh<FrameImpl, mesh_core::integrity::crc32c>::integrity_type, mesh_core::integrity::crc32c>::value, "");
+  static_assert(std::is_same<mesh_core::mesh<FrameImpl>::config, mesh_core::default_config>::value, "");
+
+  FrameImpl leaf_impl, gateway_impl;
+  leaf_t leaf(&leaf_impl);
+  gateway_t gateway(&gateway_impl);
+  leaf.init(0x01);
+  gateway.init(0x02);
+  bool ok;
+
+  // ttl of own messages
+  ASSERT(leaf.broadcast("leaf"));
+  auto leaf_frame = leaf_impl.last;
+  ASSERT(mesh_core::message_view::parse(leaf_frame, ok).ttl == 4 && ok);
+  ASSERT(gateway.broadcast("gateway"));
+  auto gateway_frame = gateway_impl.last;
+  ASSERT(mesh_core::message_view::parse(gateway_frame, ok).ttl == MESH_CORE_TTL_DEFAULT && ok);
+
+  // only the gateway rebroadcasts
+  int leaf_tx = leaf_impl.tx_frames;
+  int gateway_tx = gateway_impl.tx_frames;
+  leaf_impl.recv_handle(gateway_frame, 0);
+  gateway_impl.recv_handle(leaf_frame, 0);
+  leaf_impl.now += MESH_CORE_DELAY_MS_MAX + 1;
+  gateway_impl.now += MESH_CORE_DELAY_MS_MAX + 1;
+  leaf.poll();
+  gateway.poll();
+  ASSERT(leaf_impl.tx_frames == leaf_tx);
+  ASSERT(gateway_impl.tx_frames == gateway_tx + 1);
+  ASSERT(mesh_core::message_view::parse(gateway_impl.last, ok).ttl == 3 && ok);
+
+  // the leaf learns next hops for its own messages
+  gateway.add_static_route(0x05, 0x06);
+  gateway.sync_route();
+  leaf_impl.recv_handle(gateway_impl.last, 0);
+  ASSERT(leaf.get_route(0x05) && leaf.get_route(0x05)->next_hop == 0x02);
+  ASSERT(leaf.send(0x05, "leaf"));
+  auto unicast = mesh_core::message_view::parse(leaf_impl.last, ok);
+  ASSERT(ok && unicast.dst == 0x05 && unicast.next_hop == 0x02);
+
+  // features of the gateway
+  mesh_core::timestamp_t synced = 0;
+  gateway.on_sync_time([&](mesh_core::timestamp_t ts) {
+    synced = ts;
+  });
+  mesh_core::message m;
+  m.type = mesh_core::message_type::sync_time;
+  m.src = 0x03;
+  m.ttl = 1;
+  m.ts = 0x1234;
+  gateway_impl.recv_handle(m.serialize(ok), 0);
+  ASSERT(synced == 0x1234);
+  int intercepted = 0;
+  gateway.set_broadcast_interceptor([&](mesh_core::message&) {
+    ++intercepted;
+    return false;
+  });
+  ASSERT(!gateway.broadcast("gateway"));
+  ASSERT(intercepted == 1);
+  gateway.set_broadcast_interceptor(nullptr);
+
+  // features of the gateway regardless of the MESH_CORE_ENABLE_* defaults
+  ASSERT(gateway.stats().tx[(int)mesh_core::message_type::broadcast].frames == 2);
+  ASSERT(gateway.send_reliable(0x05, "r1") && gateway.send_reliable(0x05, "r2"));
+  ASSERT(!gateway.send_reliable(0x05, "r3"));
+  ASSERT(gateway.reliable_pending() == 2);
+  ASSERT(gateway.send_large(0x05, std::string(gateway_t::DataSizeMax * 2, 'x')));
+  ASSERT(gateway.sending_large());
+  gateway.set_hop_ack(false);
+
+  // the leaf has none of them, a reliable frame is dropped without an ack
+  int leaf_recv = 0;
+  leaf.on_recv([&](mesh_core::addr_t, mesh_core::data_view) {
+    ++leaf_recv;
+  });
+  leaf_tx = leaf_impl.tx_frames;
+  m.type = mesh_core::message_type::reliable_data;
+  m.src = 0x02;
+  m.dst = 0x01;
+  m.next_hop = 0x01;
+  m.seq = 10;
+  m.data = "reliable";
+  leaf_impl.recv_handle(m.serialize(ok), 0);
+  ASSERT(leaf_recv == 0 && leaf_impl.tx_frames == leaf_tx);
+
+  // values of Config
+  ASSERT(leaf.airtime_budget_us() == (uint32_t)((uint64_t)MESH_CORE_DUTY_CYCLE_WINDOW_MS * 10));
+  ASSERT(gateway.airtime_budget_us() == UINT32_MAX);
+}
+
+/**
+ * a bridge of two transports, e.g. LoRa and RS-485, keep frames of each interface
+ */
+struct BridgeImpl {
+  static const mesh_core::iface_t InterfaceNum = 2;
+  std::vector<std::string> frames[InterfaceNum];
+  mesh_core::recv_handle_t recv_handles[InterfaceNum];
+  mesh_core::timestamp_t now = 1000;
+
+  void broadcast(mesh_core::iface_t iface, mesh_core::data_view frame) {
+    frames[iface].emplace_back(frame.data(), frame.size());
+  }
+
+  void set_recv_handle(mesh_core::iface_t iface, mesh_core::recv_handle_t handle) {
+    recv_handles[iface] = std::move(handle);
+  }
+
+  mesh_core::timestamp_t get_timestamp_ms() const {
+    return now;
+  }
+
+  int count(mesh_core::iface_t iface, mesh_core::message_type type) const {
+    int n = 0;
+    for (const auto& frame : frames[iface]) {
+      bool ok;
+      if (mesh_core::message_view::parse(frame, ok).type == type && ok) ++n;
+    }
+    return n;
+  }
+};
+
+static std::string make_frame(mesh_core::message_type type, mesh_core::addr_t src, mesh_core::addr_t dst, mesh_core::addr_t next_hop, mesh_core::seq_t seq,
+                              mesh_core::data_view data) {
+  mesh_core::message m;
+  m.type = type;
+  m.src = src;
+  m.dst = dst;
+  m.next_hop = next_hop;
+  m.seq = seq;
+  m.ttl = mesh_core::TTL_DEFAULT;
+  m.data = data;
+  bool ok;
+  return m.serialize(ok);
+}
+
+/**
+ * route advertisement of a neighbor: itself and a route to `dst`
+ */
+static std::string make_route_frame(mesh_core::addr_t src, mesh_core::seq_t seq, mesh_core::addr_t dst, uint8_t metric) {
+  mesh_core::route_msg rms[2];
+  rms[0].dst = src;
+  rms[0].next_hop = src;
+  rms[0].metric = 0;
+  rms[1].dst = dst;
+  rms[1].next_hop = dst;
+  rms[1].metric = metric;
+  return make_frame(mesh_core::message_type::route_info, src, 0, src, seq, mesh_core::data_view(rms, sizeof(rms)));
+}
+
+static void test_interfaces() {
+  using mesh_core::message_type;
+  using bridge_t = mesh_core::mesh<BridgeImpl>;
+  static_assert(bridge_t::InterfaceNum == 2, "");
+  static_assert(mesh_core::mesh<PollImpl>::InterfaceNum == 1, "");
+
+  BridgeImpl impl;
+  bridge_t bridge(&impl);
+  bridge.set_relay_mode(mesh_core::relay_mode::flooding);
+  // RS-485: slower, a bus where all nodes hear each other
+  mesh_core::interface_config bus;
+  bus.cost = 2;
+  bus.reflood = false;
+  ASSERT(bridge.set_interface(1, bus));
+  ASSERT(!bridge.set_interface(2, bus));
+  bus.cost = 0;
+  ASSERT(!bridge.set_interface(1, bus));
+  ASSERT(bridge.get_interface(1).cost == 2);
+  bridge.init(0x10);
+  ASSERT(impl.recv_handles[0] && impl.recv_handles[1]);
+  // route request on both, serialized once
+  ASSERT(impl.frames[0].size() == 1 && impl.frames[0] == impl.frames[1]);
+
+  // 0x01 on LoRa and 0x02 on the bus both reach 0x03, the cheaper one wins
+  impl.recv_handles[0](make_route_frame(0x01, 1, 0x03, 1), 0);
+  impl.recv_handles[1](make_route_frame(0x02, 1, 0x03, 1), 0);
+  auto r1 = bridge.get_route(0x01);
+  auto r2 = bridge.get_route(0x02);
+  auto r3 = bridge.get_route(0x03);
+  ASSERT(r1 && r1->iface == 0 && r1->metric == 1);
+  ASSERT(r2 && r2->iface == 1 && r2->metric == 2);
+  ASSERT(r3 && r3->iface == 0 && r3->next_hop == 0x01 && r3->metric == 2);
+
+  // unicast on the interface of its route only
+  for (auto& f : impl.frames) f.clear();
+  ASSERT(bridge.send(0x02, "bus"));
+  ASSERT(impl.frames[0].empty() && impl.frames[1].size() == 1);
+  ASSERT(bridge.send(0x03, "lora"));
+  ASSERT(impl.frames[0].size() == 1 && impl.frames[1].size() == 1);
+  // forward from LoRa to the bus
+  impl.recv_handles[0](make_frame(message_type::user_data, 0x01, 0x02, 0x10, 2, "bridged"), 0);
+  ASSERT(impl.frames[0].size() == 1 && impl.frames[1].size() == 2);
+
+  // a flood from the bus goes to LoRa only, its copy from LoRa is a duplicate
+  int recv = 0;
+  bridge.on_recv([&recv](mesh_core::addr_t, mesh_core::data_view data) {
+    if (data == "flood") ++recv;
+  });
+  for (auto& f : impl.frames) f.clear();
+  auto flood = make_frame(message_type::broadcast, 0x02, 0, 0x02, 3, "flood");
+  impl.recv_handles[1](flood, 0);
+  impl.recv_handles[0](flood, 0);
+  impl.now += MESH_CORE_DELAY_MS_MAX + 1;
+  bridge.poll();
+  ASSERT(recv == 1);
+  ASSERT(impl.count(0, message_type::broadcast) == 1 && impl.count(1, message_type::broadcast) == 0);
+  // a flood from LoRa goes to both
+  impl.recv_handles[0](make_frame(message_type::broadcast, 0x01, 0, 0x01, 3, "flood"), 0);
+  impl.now += MESH_CORE_DELAY_MS_MAX + 1;
+  bridge.poll();
+  ASSERT(recv == 2);
+  ASSERT(impl.count(0, message_type::broadcast) == 2 && impl.count(1, message_type::broadcast) == 1);
+
+  // no floods on LoRa
+  mesh_core::interface_config lora;
+  lora.flood = false;
+  ASSERT(bridge.set_interface(0, lora));
+  ASSERT(bridge.broadcast("own"));
+  ASSERT(impl.count(0, message_type::broadcast) == 2 && impl.count(1, message_type::broadcast) == 2);
+}
+
+/**
+ * keep all frames
+ */
+struct CollectImpl : PollImpl {
+  std::vector<std::string> frames;
+
+  void broadcast(mesh_core::data_view frame) {
+    ++tx_frames;
+    frames.emplace_back(frame.data(), frame.size());
+  }
+};
+
+static void test_concurrent() {
+  {
+    // ring: full and in order
+    mesh_core::detail::mpsc_ring<int, 4> ring;
+    for (int i = 0; i < 4; ++i) {
+      ASSERT(ring.push([i](int& v) {
+        v = i;
+      }));
+    }
+    ASSERT(!ring.push([](int&) {}));
+    for (int i = 0; i < 4; ++i) {
+      int v = -1;
+      ASSERT(ring.pop([&v](int& x) {
+        v = x;
+      }));
+      ASSERT(v == i);
+    }
+    ASSERT(!ring.pop([](int&) {}));
+  }
+
+  CollectImpl impl;
+  using mesh_t = mesh_core::mesh<CollectImpl>;
+  mesh_t mesh(&impl);
+  mesh.init(0x01);
+  mesh.add_static_route(0x10, 0x11);
+  std::atomic<int> notifies{0};
+  mesh_core::concurrent_mesh<mesh_t> front(mesh, [&notifies] {
+    ++notifies;
+  });
+  ASSERT(front.routes()->routes.empty());
+
+  // producers on other threads, the owner thread drains
+  const int producers = 4;
+  const int num = 2000;
+  std::vector<std::thread> threads;
+  for (int p = 0; p < producers; ++p) {
+    threads.emplace_back([&front, p] {
+      for (int i = 0; i < num; ++i) {
+        uint8_t data[3] = {(uint8_t)p, (uint8_t)(i >> 8), (uint8_t)i};
+        while (!front.send(0x10, mesh_core::data_view(data, sizeof(data)))) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  int drains = 0;
+  int recv = 0;
+  int next[producers] = {};
+  while (recv < producers * num) {
+    front.drain();
+    ++drains;
+    for (const auto& frame : impl.frames) {
+      bool ok;
+      auto msg = mesh_core::message_view::parse(frame, ok);
+      if (!ok || msg.type != mesh_core::message_type::user_data) continue;
+      ASSERT(msg.data.size() == 3);
+      auto d = (const uint8_t*)msg.data.data();
+      // in order for each producer
+      ASSERT(d[0] < producers && (d[1] << 8 | d[2]) == next[d[0]]);
+      ++next[d[0]];
+      ++recv;
+    }
+    impl.frames.clear();
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  ASSERT(front.failed() == 0);
+  ASSERT(front.pending() == 0);
+  // one notify per drain at most
+  ASSERT(notifies > 0 && notifies <= drains + 1);
+  ASSERT(!front.send(0x10, std::string(mesh_t::DataSizeMax + 1, 'x')));
+
+  // route snapshot, a new one only if changed
+  auto routes = front.routes();
+  ASSERT(routes->version == 1);
+  ASSERT(routes->find(0x10) && routes->find(0x10)->next_hop == 0x11);
+  ASSERT(routes->find(0x01) && routes->find(0x01)->metric == 0);
+  ASSERT(routes->find(0x20) == nullptr);
+  front.drain();
+  ASSERT(front.routes() == routes);
+  mesh.add_static_route(0x20, 0x11);
+  front.publish_routes();
+  ASSERT(front.routes()->version == 2 && front.routes()->find(0x20));
+  ASSERT(routes->find(0x20) == nullptr);
+}
+
+/**
+ * @return false for timeout
+ */
+template <typename F>
+static bool wait_for(F&& f, uint32_t timeout_ms) {
+  auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+  while (!f()) {
+    if (std::chrono::steady_clock::now() > end) return false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  return true;
+}
+
+struct host_config : mesh_core::default_config {
+  // converge in ms, not seconds
+  static const uint32_t RouteTriggerIntervalMs = 10;
+};
+
+static void test_host() {
+  using host_t = mesh_core::mesh_host<host_config>;
+  host_t host(2);
+  ASSERT(host.shard_num() == 2);
+
+  // line 1-2-3-4-5-6, 1-2 and 5-6 on shard 0, 3-4 on shard 1, both co-located and cross shard neighbours
+  const int shards[] = {0, 0, 1, 1, 0, 0};
+  for (int i = 0; i < 6; ++i) {
+    ASSERT(host.add_node((mesh_core::addr_t)(i + 1), shards[i]));
+  }
+  ASSERT(!host.add_node(1));
+  for (int i = 1; i < 6; ++i) {
+    ASSERT(host.link((mesh_core::addr_t)i, (mesh_core::addr_t)(i + 1)));
+  }
+  ASSERT(!host.link(1, 7));
+  ASSERT(host.shard_of(3) == 1 && host.shard_of(6) == 0 && host.shard_of(7) == -1);
+
+  std::atomic<int> recv{0};
+  std::atomic<int> uplink{0};
+  host.post(6, [&recv](host_t::mesh_t& m) {
+    m.on_recv([&recv](mesh_core::addr_t, mesh_core::data_view data) {
+      if (data == "hello") ++recv;
+    });
+  });
+  ASSERT(host.set_uplink(1, [&uplink](mesh_core::data_view) {
+    ++uplink;
+  }));
+  host.start();
+  ASSERT(!host.add_node(7));
+
+  std::atomic<bool> routed{false};
+  ASSERT(wait_for(
+      [&] {
+        host.post(1, [&routed](host_t::mesh_t& m) {
+          if (m.get_route(6)) routed = true;
+        });
+        return routed.load();
+      },
+      MESH_CORE_ROUTE_SYNC_INTERVAL_MS * 2));
+  ASSERT(host.post(1, [](host_t::mesh_t& m) {
+    m.send(6, "hello");
+  }));
+  ASSERT(wait_for(
+      [&] {
+        return recv == 1;
+      },
+      1000));
+
+  // a frame from the outside
+  mesh_core::message m;
+  m.type = mesh_core::message_type::user_data;
+  m.src = 0x50;
+  m.dst = 6;
+  m.next_hop = 6;
+  m.seq = 1;
+  m.ttl = 1;
+  m.data = "hello";
+  bool ok;
+  auto frame = m.serialize(ok);
+  ASSERT(ok && host.deliver(6, frame));
+  ASSERT(!host.deliver(7, frame));
+  ASSERT(wait_for(
+      [&] {
+        return recv == 2;
+      },
+      1000));
+
+  ASSERT(uplink > 0);
+  ASSERT(host.frames() > 0 && host.drops() == 0);
+  ASSERT(!host.post(7, [](host_t::mesh_t&) {}));
+  host.stop();
 }
 
 static void test_random() {
@@ -80,6 +1538,39 @@ static void test_random() {
 int main() {
   MESH_CORE_LOG("version: %d", MESH_CORE_VERSION);
   test_message();
+  test_proto();
+  test_crc();
+  test_route_table();
+  test_dup_filter();
+#if MESH_CORE_ADDR_BITS == 16
+  test_wide_address();
+#endif
+  test_rebroadcast_table();
+#ifdef MESH_CORE_ENABLE_MPR
+  test_mpr_selector();
+#endif
+  test_inplace_function();
+  test_frame_pool();
+#ifdef MESH_CORE_ENABLE_FRAGMENT
+  test_reassembly();
+#endif
+#ifdef MESH_CORE_ENABLE_RELIABLE
+  test_reliable();
+  test_reliable_loopback();
+#endif
+#ifdef MESH_CORE_ENABLE_HOP_ACK
+  test_hop_ack_table();
+#endif
+  test_tx_queue();
+  test_tx_done();
+  test_airtime_budget();
+  test_timer_wheel();
+  test_poll_driven();
+  test_route_delta();
+  test_config();
+  test_interfaces();
+  test_concurrent();
+  test_host();
   test_random();
 
   bool TEST_FLAG_RECV_HELLO = false;
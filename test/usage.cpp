@@ -6,17 +6,20 @@
  * NOTE:
  * 1. broadcast and recv_handle should ensure packet is complete
  * 2. all methods can be static or non-static
+ * 3. handles are never reset to null, they do nothing once mesh is destroyed
  */
 struct Impl {
   /**
-   * @param data binary data to broadcast
+   * @param data binary data to broadcast, only valid during the call.
+   * `std::string` is also supported, but will copy.
    */
-  static void broadcast(std::string data) {
+  static void broadcast(mesh_core::data_view data) {
     (void)(data);
   }
 
   /**
    * @param handle store it, call it on receive broadcast.
+   * `data_view` only need to be valid during the call, no copy inside mesh_core.
    */
   static void set_recv_handle(mesh_core::recv_handle_t handle) {
     (void)(handle);
@@ -30,6 +33,8 @@ struct Impl {
   }
 
   /**
+   * optional, called for the nearest internal timer.
+   * if not supplied, call `mesh.poll()` when `mesh.next_timeout()` ms elapsed.
    * @param handle call it after `ms`
    * @param ms milliseconds
    */
@@ -37,14 +42,31 @@ struct Impl {
     (void)(handle);
     (void)(ms);
   }
+
+  /**
+   * optional, frames are queued by priority and sent one by one.
+   * if not supplied, frames are sent at once.
+   * @param handle store it, call it when the last broadcast is sent and the next one can be accepted
+   */
+  static void set_tx_done_handle(mesh_core::tx_done_handle_t handle) {
+    (void)(handle);
+  }
+
+  /**
+   * optional, airtime of a frame, for duty cycle limit, see `mesh.set_duty_cycle()`
+   * @param bytes frame size
+   */
+  static uint32_t airtime_us(size_t bytes) {
+    return (uint32_t)(bytes * 8 * 1000000 / 9600);
+  }
 };
 
 int main() {
   Impl impl;
   mesh_core::mesh<Impl> mesh(&impl);
   mesh.init(0x00);
-  mesh.on_recv([](mesh_core::addr_t addr, const mesh_core::data_t& data) {
-    MESH_CORE_LOG("addr: 0x%02X, data: %s", addr, data.c_str());
+  mesh.on_recv([](mesh_core::addr_t addr, mesh_core::data_view data) {
+    MESH_CORE_LOG("addr: 0x%02X, data: %.*s", addr, (int)data.size(), data.data());
   });
   mesh.send(0x01, "hello");
   return 0;